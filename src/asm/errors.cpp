@@ -0,0 +1,82 @@
+#include "errors.hpp"
+#include <algorithm>
+
+
+namespace dcpupp
+{
+	ErrorPrinter::ErrorPrinter(
+		std::ostream &out,
+		SourceIterator begin,
+		SourceIterator end
+		)
+		: m_out(out)
+		, m_begin(begin)
+		, m_end(end)
+	{
+	}
+	
+	void ErrorPrinter::handleError(const LexicalException &e)
+	{
+		m_out << "Lexical error (" << (getLine(e.position) + 1) << "): ";
+		switch (e.error)
+		{
+		case LexErr_InvalidCharacter: m_out << "Invalid character '" << *e.position << "'"; break;
+		case LexErr_IncompleteInteger: m_out << "Incomplete integer"; break;
+		case LexErr_UnexpectedCharacter: m_out << "Unexpected character '" << *e.position << "'"; break;
+		case LexErr_IncompleteString: m_out << "Incomplete string"; break;
+		case LexErr_InvalidEscapeSequence: m_out << "Invalid escape character '" << *e.position << "'"; break;
+		default: m_out << "Unknown error"; break;
+		}
+		m_out << std::endl;
+	}
+	
+	void ErrorPrinter::handleError(const SyntaxException &e)
+	{
+		m_out << "Syntax error (" << (getLine(e.position) + 1) << "): ";
+		switch (e.error)
+		{
+		case SynErr_LabelNameExpected: m_out << "Label name expected: " << getRestOfLine(e.position); break;
+		case SynErr_MissingRightBracket: m_out << "Closing bracket ']' expected: " << getRestOfLine(e.position); break;
+		case SynErr_KeywordExpected: m_out << "Keyword expected: " << getRestOfLine(e.position); break;
+		case SynErr_CommaExpected: m_out << "Comma expected: " << getRestOfLine(e.position); break;
+		case SynErr_ArgumentExpected: m_out << "Argument expected: " << getRestOfLine(e.position); break;
+		case SynErr_DataExpected: m_out << "Data expected: " << getRestOfLine(e.position); break;
+		case SynErr_UniversalRegisterExpected: m_out << "Universal register expected: " << getRestOfLine(e.position); break;
+		case SynErr_ReservedSizeExpected: m_out << "Reserved size expected: " << getRestOfLine(e.position); break;
+		default: m_out << "Unknown error"; break;
+		}
+		m_out << std::endl;
+	}
+	
+	void ErrorPrinter::handleError(const SemanticException &e)
+	{
+		m_out << "Semantic error (" << (getLine(e.position) + 1) << "): ";
+		switch (e.error)
+		{
+		case SemErr_UnknownIdentifier: m_out << "Unknown identifier: " << getRestOfLine(e.position); break;
+		default: m_out << "Unknown error"; break;
+		}
+		m_out << std::endl;
+	}
+	
+	void ErrorPrinter::handleRedefinition(
+		SourceIterator previous,
+		SourceIterator redefined,
+		const std::string &name
+		)
+	{
+		m_out << "Redefinition (" << (getLine(redefined) + 1) << "): '" << name
+			<< "' was defined in line " << (getLine(previous) + 1) << std::endl;
+	}
+	
+	unsigned ErrorPrinter::getLine(SourceIterator position) const
+	{
+		return std::count(m_begin, position, '\n');
+	}
+	
+	std::string ErrorPrinter::getRestOfLine(SourceIterator position) const
+	{
+		return std::string(position,
+			std::find(position, m_end, '\n'));
+	}
+}
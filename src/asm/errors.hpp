@@ -0,0 +1,39 @@
+#ifndef DCPUPP_ASM_ERRORS_HPP
+#define DCPUPP_ASM_ERRORS_HPP
+
+
+#include "compiler.hpp"
+#include <ostream>
+
+
+namespace dcpupp
+{
+	//Writes a readable message with the line number for every error.
+	struct ErrorPrinter : ICompilerErrorHandler
+	{
+		explicit ErrorPrinter(
+			std::ostream &out,
+			SourceIterator begin,
+			SourceIterator end
+			);
+		virtual void handleError(const LexicalException &e);
+		virtual void handleError(const SyntaxException &e);
+		virtual void handleError(const SemanticException &e);
+		virtual void handleRedefinition(
+			SourceIterator previous,
+			SourceIterator redefined,
+			const std::string &name
+			);
+		
+	private:
+	
+		std::ostream &m_out;
+		SourceIterator m_begin, m_end;
+		
+		unsigned getLine(SourceIterator position) const;
+		std::string getRestOfLine(SourceIterator position) const;
+	};
+}
+
+
+#endif
@@ -4,6 +4,7 @@
 #include <fstream>
 #include <algorithm>
 #include "compiler.hpp"
+#include "errors.hpp"
 using namespace std;
 using namespace dcpupp;
 
@@ -13,86 +14,6 @@ static void printHelp()
 	cout << "" << endl;
 }
 
-struct ErrorHandler : ICompilerErrorHandler
-{
-	SourceIterator begin, end;
-	
-	explicit ErrorHandler(
-		SourceIterator begin,
-		SourceIterator end)
-		: begin(begin)
-		, end(end)
-	{
-	}
-	
-	virtual void handleError(const LexicalException &e)
-	{
-		cerr << "Lexical error (" << (getLine(e.position) + 1) << "): ";
-		switch (e.error)
-		{
-		case LexErr_InvalidCharacter: cerr << "Invalid character '" << *e.position << "'"; break;
-		case LexErr_IncompleteInteger: cerr << "Incomplete integer"; break;
-		case LexErr_UnexpectedCharacter: cerr << "Unexpected character '" << *e.position << "'"; break;
-		case LexErr_IncompleteString: cerr << "Incomplete string"; break;
-		case LexErr_InvalidEscapeSequence: cerr << "Invalid escape character '" << *e.position << "'"; break;
-		default: cerr << "Unknown error"; break;
-		}
-		cerr << endl;
-	}
-	
-	virtual void handleError(const SyntaxException &e)
-	{
-		cerr << "Syntax error (" << (getLine(e.position) + 1) << "): ";
-		switch (e.error)
-		{
-		case SynErr_LabelNameExpected: cerr << "Label name expected: " << getRestOfLine(e.position); break;
-		case SynErr_MissingRightBracket: cerr << "Closing bracket ']' expected: " << getRestOfLine(e.position); break;
-		case SynErr_KeywordExpected: cerr << "Keyword expected: " << getRestOfLine(e.position); break;
-		case SynErr_CommaExpected: cerr << "Comma expected: " << getRestOfLine(e.position); break;
-		case SynErr_ArgumentExpected: cerr << "Argument expected: " << getRestOfLine(e.position); break;
-		case SynErr_DataExpected: cerr << "Data expected: " << getRestOfLine(e.position); break;
-		case SynErr_UniversalRegisterExpected: cerr << "Universal register expected: " << getRestOfLine(e.position); break;
-		case SynErr_ReservedSizeExpected: cerr << "Reserved size expected: " << getRestOfLine(e.position); break;
-		default: cerr << "Unknown error"; break;
-		}
-		cerr << endl;
-	}
-	
-	virtual void handleError(const SemanticException &e)
-	{
-		cerr << "Semantic error (" << (getLine(e.position) + 1) << "): ";
-		switch (e.error)
-		{
-		case SemErr_UnknownIdentifier: cerr << "Unknown identifier: " << getRestOfLine(e.position); break;
-		default: cerr << "Unknown error"; break;
-		}
-		cerr << endl;
-	}
-	
-	virtual void handleRedefinition(
-		SourceIterator previous,
-		SourceIterator redefined,
-		const std::string &name
-		)
-	{
-		cerr << "Redefinition (" << (getLine(redefined) + 1) << "): '" << name
-			<< "' was defined in line " << (getLine(previous) + 1) << endl;
-	}
-	
-private:
-
-	unsigned getLine(SourceIterator position) const
-	{
-		return std::count(begin, position, '\n');
-	}
-	
-	std::string getRestOfLine(SourceIterator position) const
-	{
-		return std::string(position,
-			std::find(position, end, '\n'));
-	}
-};
-
 struct LinePrinter : ILineHandler
 {
 	std::ostream &dest;
@@ -141,7 +62,8 @@ static void assemble(const std::string &fileName, const std::string *feedbackFil
 	Parser parser(
 		scanner);
 	MemoryBuffer code;
-	ErrorHandler errorHandler(
+	ErrorPrinter errorHandler(
+		cerr,
 		source.begin(),
 		source.end());
 	Compiler compiler(
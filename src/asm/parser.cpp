@@ -1,4 +1,5 @@
 #include "parser.hpp"
+#include "common/instructions.hpp"
 #include <cassert>
 #include <array>
 #include <string>
@@ -174,7 +175,7 @@ namespace dcpupp
 	
 	Word RegisterArgument::getExtraWordCount() const
 	{
-		return 0;
+		return getArgumentLength(Arg_Register + id);
 	}
 	
 	bool RegisterArgument::hasExtraWord(
@@ -183,7 +184,7 @@ namespace dcpupp
 		ILabelResolver &resolver
 		) const
 	{
-		typeCode = id;
+		typeCode = (Arg_Register + id);
 		return false;
 	}
 	
@@ -200,7 +201,7 @@ namespace dcpupp
 	
 	Word RegisterPtrArgument::getExtraWordCount() const
 	{
-		return 0;
+		return getArgumentLength(Arg_PtrRegister + id);
 	}
 	
 	bool RegisterPtrArgument::hasExtraWord(
@@ -209,7 +210,7 @@ namespace dcpupp
 		ILabelResolver &resolver
 		) const
 	{
-		typeCode = (8 + id);
+		typeCode = (Arg_PtrRegister + id);
 		return false;
 	}
 	
@@ -232,7 +233,7 @@ namespace dcpupp
 	
 	Word RegisterWordPtrArgument::getExtraWordCount() const
 	{
-		return 1;
+		return getArgumentLength(Arg_PtrRegisterWord + id);
 	}
 	
 	bool RegisterWordPtrArgument::hasExtraWord(
@@ -241,7 +242,7 @@ namespace dcpupp
 		ILabelResolver &resolver
 		) const
 	{
-		typeCode = (16 + id);
+		typeCode = (Arg_PtrRegisterWord + id);
 		extra = this->extra->getValue(resolver);
 		return true;
 	}
@@ -254,7 +255,7 @@ namespace dcpupp
 	
 	Word PopArgument::getExtraWordCount() const
 	{
-		return 0;
+		return getArgumentLength(Arg_Pop);
 	}
 	
 	bool PopArgument::hasExtraWord(
@@ -263,7 +264,7 @@ namespace dcpupp
 		ILabelResolver &resolver
 		) const
 	{
-		typeCode = 0x18;
+		typeCode = Arg_Pop;
 		return false;
 	}
 	
@@ -275,7 +276,7 @@ namespace dcpupp
 	
 	Word PeekArgument::getExtraWordCount() const
 	{
-		return 0;
+		return getArgumentLength(Arg_Peek);
 	}
 	
 	bool PeekArgument::hasExtraWord(
@@ -284,7 +285,7 @@ namespace dcpupp
 		ILabelResolver &resolver
 		) const
 	{
-		typeCode = 0x19;
+		typeCode = Arg_Peek;
 		return false;
 	}
 	
@@ -296,7 +297,7 @@ namespace dcpupp
 	
 	Word PushArgument::getExtraWordCount() const
 	{
-		return 0;
+		return getArgumentLength(Arg_Push);
 	}
 	
 	bool PushArgument::hasExtraWord(
@@ -305,7 +306,7 @@ namespace dcpupp
 		ILabelResolver &resolver
 		) const
 	{
-		typeCode = 0x1a;
+		typeCode = Arg_Push;
 		return false;
 	}
 			
@@ -317,7 +318,7 @@ namespace dcpupp
 	
 	Word SPArgument::getExtraWordCount() const
 	{
-		return 0;
+		return getArgumentLength(Arg_SP);
 	}
 	
 	bool SPArgument::hasExtraWord(
@@ -326,7 +327,7 @@ namespace dcpupp
 		ILabelResolver &resolver
 		) const
 	{
-		typeCode = 0x1b;
+		typeCode = Arg_SP;
 		return false;
 	}
 			
@@ -338,7 +339,7 @@ namespace dcpupp
 	
 	Word PCArgument::getExtraWordCount() const
 	{
-		return 0;
+		return getArgumentLength(Arg_PC);
 	}
 	
 	bool PCArgument::hasExtraWord(
@@ -347,7 +348,7 @@ namespace dcpupp
 		ILabelResolver &resolver
 		) const
 	{
-		typeCode = 0x1c;
+		typeCode = Arg_PC;
 		return false;
 	}
 			
@@ -359,7 +360,7 @@ namespace dcpupp
 	
 	Word OArgument::getExtraWordCount() const
 	{
-		return 0;
+		return getArgumentLength(Arg_O);
 	}
 	
 	bool OArgument::hasExtraWord(
@@ -368,7 +369,7 @@ namespace dcpupp
 		ILabelResolver &resolver
 		) const
 	{
-		typeCode = 0x1d;
+		typeCode = Arg_O;
 		return false;
 	}
 			
@@ -387,7 +388,7 @@ namespace dcpupp
 	
 	Word WordPtrArgument::getExtraWordCount() const
 	{
-		return 1;
+		return getArgumentLength(Arg_PtrWord);
 	}
 	
 	bool WordPtrArgument::hasExtraWord(
@@ -396,7 +397,7 @@ namespace dcpupp
 		ILabelResolver &resolver
 		) const
 	{
-		typeCode = 0x1e;
+		typeCode = Arg_PtrWord;
 		extra = this->extra->getValue(resolver);
 		return true;
 	}
@@ -414,7 +415,8 @@ namespace dcpupp
 	
 	Word WordArgument::getExtraWordCount() const
 	{
-		return extra->isBelow(32) ? 0 : 1;
+		return getArgumentLength(
+			extra->isBelow(32) ? Arg_SmallLiteral : Arg_Word);
 	}
 	
 	bool WordArgument::hasExtraWord(
@@ -427,12 +429,12 @@ namespace dcpupp
 		if (this->extra->isBelow(32))
 		{
 			assert(value < 32);
-			typeCode = 0x20 + value;
+			typeCode = Arg_SmallLiteral + value;
 			return false;
 		}
 		else
 		{
-			typeCode = 0x1f;
+			typeCode = Arg_Word;
 			extra = value;
 			return true;
 		}
@@ -461,6 +463,14 @@ namespace dcpupp
 		case NBOp_Jsr:
 			name = "JSR";
 			break;
+			
+		case NBOp_Wait:
+			name = "WAIT";
+			break;
+			
+		case NBOp_Hyp:
+			name = "HYP";
+			break;
 		
 		default:
 			assert(false);
@@ -872,6 +882,14 @@ namespace dcpupp
 				{
 					statement = parseUnaryStatement(NBOp_Jsr);
 				}
+				else if (identifier == "WAIT")
+				{
+					statement = parseUnaryStatement(NBOp_Wait);
+				}
+				else if (identifier == "HYP")
+				{
+					statement = parseUnaryStatement(NBOp_Hyp);
+				}
 				else if (identifier == "DAT")
 				{
 					statement = parseData();
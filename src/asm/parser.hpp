@@ -50,27 +50,6 @@ namespace dcpupp
 			);
 	};
 	
-	enum
-	{
-		UniversalRegisterCount = 8,
-	};
-	
-	enum ArgumentType
-	{
-		Arg_Register = 0x00,
-		Arg_PtrRegister = 0x08,
-		Arg_PtrRegisterWord = 0x10,
-		Arg_Pop = 0x18,
-		Arg_Peek = 0x19,
-		Arg_Push = 0x1a,
-		Arg_SP = 0x1b,
-		Arg_PC = 0x1c,
-		Arg_O = 0x1d,
-		Arg_PtrWord = 0x1e,
-		Arg_Word = 0x1f,
-		Arg_SmallLiteral = 0x20,
-	};
-	
 	struct IMemoryWriter
 	{
 		virtual ~IMemoryWriter();
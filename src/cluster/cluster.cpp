@@ -0,0 +1,224 @@
+#include "cluster.hpp"
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		//Lets a number of threads wait for each other. Can be used again as
+		//soon as all threads have left.
+		struct Barrier
+		{
+			explicit Barrier(std::size_t count)
+				: m_count(count)
+				, m_waiting(0)
+				, m_generation(0)
+			{
+			}
+			
+			void wait()
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				const auto generation = m_generation;
+				if (++m_waiting == m_count)
+				{
+					m_waiting = 0;
+					++m_generation;
+					m_allArrived.notify_all();
+					return;
+				}
+				
+				while (generation == m_generation)
+				{
+					m_allArrived.wait(lock);
+				}
+			}
+			
+		private:
+			
+			std::mutex m_mutex;
+			std::condition_variable m_allArrived;
+			const std::size_t m_count;
+			std::size_t m_waiting;
+			std::uint64_t m_generation;
+		};
+		
+		//messages which cannot be delivered yet wait on the host up to this number
+		const std::size_t MaxPendingMessages = 1024;
+	}
+	
+	Cluster::Cluster(std::vector<Machine> machines, std::uint64_t lookahead)
+		: m_lookahead(std::max<std::uint64_t>(lookahead, 1))
+		, m_quantum(0)
+	{
+		for (auto m = machines.begin(); m != machines.end(); ++m)
+		{
+			std::unique_ptr<Node> node(new Node);
+			node->machine = std::move(*m);
+			node->sent = node->delivered = node->dropped = 0;
+			m_nodes.push_back(std::move(node));
+		}
+		
+		const auto count = m_nodes.size();
+		for (std::size_t i = 0; i < count * count; ++i)
+		{
+			m_links.push_back(std::unique_ptr<Link>(new Link));
+		}
+	}
+	
+	void Cluster::runParallel(std::uint64_t until)
+	{
+		const auto quantumCount = getQuantumCount(until);
+		const auto first = m_quantum;
+		Barrier barrier(m_nodes.size());
+		std::vector<std::thread> threads;
+		
+		for (std::size_t i = 0; i < m_nodes.size(); ++i)
+		{
+			threads.push_back(std::thread([this, i, first, quantumCount, &barrier]()
+			{
+				for (auto q = first; q < first + quantumCount; ++q)
+				{
+					runQuantum(i, q);
+					
+					//everything sent in this quantum is in the links now
+					barrier.wait();
+				}
+			}));
+		}
+		
+		for (auto t = threads.begin(); t != threads.end(); ++t)
+		{
+			t->join();
+		}
+		
+		m_quantum += quantumCount;
+	}
+	
+	void Cluster::runRoundRobin(std::uint64_t until)
+	{
+		const auto quantumCount = getQuantumCount(until);
+		for (std::uint64_t n = 0; n < quantumCount; ++n, ++m_quantum)
+		{
+			for (std::size_t i = 0; i < m_nodes.size(); ++i)
+			{
+				runQuantum(i, m_quantum);
+			}
+		}
+	}
+	
+	std::size_t Cluster::getMachineCount() const
+	{
+		return m_nodes.size();
+	}
+	
+	const Machine &Cluster::getMachine(std::size_t index) const
+	{
+		return m_nodes[index]->machine;
+	}
+	
+	ClusterStatistics Cluster::getStatistics() const
+	{
+		ClusterStatistics statistics;
+		statistics.quanta = m_quantum;
+		statistics.sent = statistics.delivered = statistics.dropped = 0;
+		for (auto n = m_nodes.begin(); n != m_nodes.end(); ++n)
+		{
+			statistics.sent += (*n)->sent;
+			statistics.delivered += (*n)->delivered;
+			statistics.dropped += (*n)->dropped;
+		}
+		return statistics;
+	}
+	
+	std::uint64_t Cluster::getQuantumCount(std::uint64_t until) const
+	{
+		const auto end = (until + m_lookahead - 1) / m_lookahead;
+		return (end > m_quantum) ? (end - m_quantum) : 0;
+	}
+	
+	void Cluster::runQuantum(std::size_t index, std::uint64_t quantum)
+	{
+		receive(index, quantum);
+		
+		auto &machine = m_nodes[index]->machine;
+		const auto end = (quantum + 1) * m_lookahead;
+		if (machine.cycles < end)
+		{
+			//a halted machine cannot react to messages anymore
+			if (isHalted(machine))
+			{
+				machine.cycles = end;
+			}
+			else
+			{
+				machine.runSlice(end - machine.cycles);
+			}
+		}
+		
+		send(index, quantum);
+	}
+	
+	void Cluster::receive(std::size_t index, std::uint64_t quantum)
+	{
+		auto &node = *m_nodes[index];
+		const auto count = m_nodes.size();
+		
+		for (std::size_t sender = 0; sender < count; ++sender)
+		{
+			auto &link = *m_links[sender * count + index];
+			
+			//the sender may already be putting messages of this quantum
+			//into the link
+			for (const TaggedMessage *tagged;
+				(tagged = link.front()) && tagged->quantum < quantum;
+				link.pop())
+			{
+				if (node.inbox.size() < MaxPendingMessages)
+				{
+					node.inbox.push_back(tagged->message);
+				}
+				else
+				{
+					++node.dropped;
+				}
+			}
+		}
+		
+		while (!node.inbox.empty() &&
+			Mailbox::deliver(node.machine, node.inbox.front()))
+		{
+			node.inbox.pop_front();
+			++node.delivered;
+		}
+	}
+	
+	void Cluster::send(std::size_t index, std::uint64_t quantum)
+	{
+		auto &node = *m_nodes[index];
+		const auto count = m_nodes.size();
+		
+		node.outbox.clear();
+		Mailbox::collect(node.machine, node.outbox);
+		
+		for (auto m = node.outbox.begin(); m != node.outbox.end(); ++m)
+		{
+			if (m->peer >= count)
+			{
+				++node.dropped;
+				continue;
+			}
+			
+			const TaggedMessage tagged = {quantum, {static_cast<Word>(index), m->value}};
+			const bool pushed = m_links[index * count + m->peer]->push(tagged);
+			assert(pushed);
+			(void)pushed;
+			++node.sent;
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#ifndef DCPUPP_CLUSTER_CLUSTER_HPP
+#define DCPUPP_CLUSTER_CLUSTER_HPP
+
+
+#include "mailbox.hpp"
+#include "spsc.hpp"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+
+namespace dcpupp
+{
+	struct ClusterStatistics
+	{
+		std::uint64_t quanta;
+		std::uint64_t sent;
+		std::uint64_t delivered;
+		std::uint64_t dropped;
+	};
+	
+	//Machines which exchange messages through their mailboxes.
+	//
+	//The simulated time is divided into quanta of lookahead cycles. During a
+	//quantum every machine runs on its own until its cycle counter reaches
+	//the end of the quantum. Messages sent in a quantum are delivered at the
+	//beginning of the next one in the order of the senders, so a message
+	//takes at least lookahead cycles and the machines only have to wait for
+	//each other once per quantum. The result does not depend on how the
+	//machines are scheduled: runParallel and runRoundRobin end up in exactly
+	//the same state.
+	struct Cluster
+	{
+		explicit Cluster(std::vector<Machine> machines, std::uint64_t lookahead);
+		
+		//Run whole quanta until every machine has reached at least 'until'
+		//cycles.
+		void runParallel(std::uint64_t until);
+		void runRoundRobin(std::uint64_t until);
+		
+		std::size_t getMachineCount() const;
+		const Machine &getMachine(std::size_t index) const;
+		ClusterStatistics getStatistics() const;
+		
+	private:
+		
+		struct TaggedMessage
+		{
+			std::uint64_t quantum;
+			MailboxMessage message;
+		};
+		
+		//A sender puts at most MailboxSlots messages into a link per quantum
+		//and the receiver takes them out in the next one, so a link never
+		//holds messages of more than two quanta.
+		typedef SpscQueue<TaggedMessage, 2 * MailboxSlots> Link;
+		
+		//only touched by the thread which runs the machine
+		struct Node
+		{
+			Machine machine;
+			std::deque<MailboxMessage> inbox;
+			std::vector<MailboxMessage> outbox;
+			std::uint64_t sent;
+			std::uint64_t delivered;
+			std::uint64_t dropped;
+		};
+		
+		const std::uint64_t m_lookahead;
+		std::vector<std::unique_ptr<Node>> m_nodes;
+		
+		//the link from sender s to receiver r is at s * count + r
+		std::vector<std::unique_ptr<Link>> m_links;
+		std::uint64_t m_quantum;
+		
+		std::uint64_t getQuantumCount(std::uint64_t until) const;
+		void runQuantum(std::size_t index, std::uint64_t quantum);
+		void receive(std::size_t index, std::uint64_t quantum);
+		void send(std::size_t index, std::uint64_t quantum);
+	};
+}
+
+
+#endif
@@ -0,0 +1,55 @@
+#include "mailbox.hpp"
+#include "emu/interrupts.hpp"
+
+
+namespace dcpupp
+{
+	void Mailbox::collect(Machine &machine, std::vector<MailboxMessage> &messages)
+	{
+		auto &memory = machine.memory;
+		const Word write = memory[MailboxOutboxWrite];
+		Word read = memory[MailboxOutboxRead];
+		
+		//a program which writes too far ahead loses the oldest messages
+		const Word pending = static_cast<Word>(write - read);
+		if (pending > MailboxSlots)
+		{
+			read = static_cast<Word>(write - MailboxSlots);
+		}
+		
+		for (; read != write; ++read)
+		{
+			const auto slot = MailboxOutbox + (read % MailboxSlots) * 2;
+			const MailboxMessage message = {memory[slot], memory[slot + 1]};
+			messages.push_back(message);
+		}
+		
+		if (memory[MailboxOutboxRead] != read)
+		{
+			memory[MailboxOutboxRead] = read;
+			machine.markDirty(MailboxOutboxRead);
+		}
+	}
+	
+	bool Mailbox::deliver(Machine &machine, const MailboxMessage &message)
+	{
+		auto &memory = machine.memory;
+		const Word write = memory[MailboxInboxWrite];
+		if (static_cast<Word>(write - memory[MailboxInboxRead]) >= MailboxSlots)
+		{
+			return false;
+		}
+		
+		const auto slot = MailboxInbox + (write % MailboxSlots) * 2;
+		memory[slot] = message.peer;
+		memory[slot + 1] = message.value;
+		memory[MailboxInboxWrite] = static_cast<Word>(write + 1);
+		machine.markDirty(static_cast<Word>(slot), 2);
+		machine.markDirty(MailboxInboxWrite);
+		
+		//ends a WAIT for the mailbox
+		memory[InterruptPending] |= InterruptLine_Mailbox;
+		machine.markDirty(InterruptPending);
+		return true;
+	}
+}
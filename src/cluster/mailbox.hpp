@@ -0,0 +1,52 @@
+#ifndef DCPUPP_CLUSTER_MAILBOX_HPP
+#define DCPUPP_CLUSTER_MAILBOX_HPP
+
+
+#include "emu/machine.hpp"
+#include <vector>
+
+
+namespace dcpupp
+{
+	enum
+	{
+		MailboxAddress = 0x9100,
+		MailboxSlots = 16,
+		
+		//indices which count up forever, the slot is the index % MailboxSlots
+		MailboxOutboxWrite = MailboxAddress + 0x00,
+		MailboxOutboxRead = MailboxAddress + 0x01,
+		MailboxInboxWrite = MailboxAddress + 0x02,
+		MailboxInboxRead = MailboxAddress + 0x03,
+		
+		//MailboxSlots pairs of peer and value each
+		MailboxOutbox = MailboxAddress + 0x10,
+		MailboxInbox = MailboxAddress + 0x30,
+	};
+	
+	//peer is the destination in the outbox and the source in the inbox
+	struct MailboxMessage
+	{
+		Word peer;
+		Word value;
+	};
+	
+	//To send a message the program writes it to the outbox slot of
+	//MailboxOutboxWrite and increments that index. It may do so while the
+	//index is less than MailboxSlots ahead of MailboxOutboxRead.
+	//To receive, the program reads the inbox slot of MailboxInboxRead and
+	//increments that index while it is behind MailboxInboxWrite. A delivery
+	//sets InterruptLine_Mailbox in InterruptPending, so the program can wait
+	//for messages with WAIT.
+	struct Mailbox
+	{
+		//Takes all messages the program has sent.
+		static void collect(Machine &machine, std::vector<MailboxMessage> &messages);
+		
+		//Returns false if the inbox is full.
+		static bool deliver(Machine &machine, const MailboxMessage &message);
+	};
+}
+
+
+#endif
@@ -0,0 +1,149 @@
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <cstdio>
+#include <chrono>
+#include "cluster.hpp"
+#include "emu/hash.hpp"
+using namespace std;
+using namespace dcpupp;
+
+static void printHelp()
+{
+	cout << "dcpucluster [-l<lookahead>] [-c<cycles>] [-r] [-x] image..." << endl;
+	cout << "  -r  run the machines one after another on a single thread" << endl;
+	cout << "  -x  run both ways and compare the results" << endl;
+}
+
+struct Options
+{
+	std::uint64_t lookahead;
+	std::uint64_t cycles;
+	bool roundRobin;
+	bool compare;
+	
+	Options()
+		: lookahead(1000)
+		, cycles(1000000)
+		, roundRobin(false)
+		, compare(false)
+	{
+	}
+};
+
+static vector<std::uint64_t> runCluster(
+	const vector<Machine> &machines,
+	const Options &options,
+	bool roundRobin)
+{
+	Cluster cluster(machines, options.lookahead);
+	
+	const auto started = std::chrono::steady_clock::now();
+	if (roundRobin)
+	{
+		cluster.runRoundRobin(options.cycles);
+	}
+	else
+	{
+		cluster.runParallel(options.cycles);
+	}
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - started).count();
+	
+	vector<std::uint64_t> hashes;
+	for (std::size_t i = 0; i < cluster.getMachineCount(); ++i)
+	{
+		const auto &machine = cluster.getMachine(i);
+		hashes.push_back(hashMachine(machine));
+		printf("%zu: %llu cycles, state %016llx\n",
+			i,
+			static_cast<unsigned long long>(machine.cycles),
+			static_cast<unsigned long long>(hashes.back()));
+	}
+	
+	const auto statistics = cluster.getStatistics();
+	fprintf(stderr, "%s: %llu quanta in %lld ms, %llu messages sent, %llu delivered, %llu dropped\n",
+		roundRobin ? "round robin" : "parallel",
+		static_cast<unsigned long long>(statistics.quanta),
+		static_cast<long long>(elapsed),
+		static_cast<unsigned long long>(statistics.sent),
+		static_cast<unsigned long long>(statistics.delivered),
+		static_cast<unsigned long long>(statistics.dropped));
+	return hashes;
+}
+
+int main(int argc, char **argv)
+{
+	const vector<string> args(argv + 1, argv + argc);
+	
+	vector<string> imageFileNames;
+	Options options;
+	
+	for (auto a = args.begin(); a != args.end(); ++a)
+	{
+		const auto &arg = *a;
+		assert(!arg.empty());
+		if (arg[0] == '-' &&
+			arg.size() >= 2)
+		{
+			switch (arg[1])
+			{
+			case 'l':
+				options.lookahead = stoull(arg.c_str() + 2);
+				break;
+				
+			case 'c':
+				options.cycles = stoull(arg.c_str() + 2);
+				break;
+				
+			case 'r':
+				options.roundRobin = true;
+				break;
+				
+			case 'x':
+				options.compare = true;
+				break;
+				
+			default:
+				cerr << "Invalid option '" << arg << "'";
+				return 1;
+			}
+		}
+		else
+		{
+			imageFileNames.push_back(arg);
+		}
+	}
+	
+	if (imageFileNames.empty())
+	{
+		printHelp();
+		return 0;
+	}
+	
+	//the machines get their ids in the order of the images
+	vector<Machine> machines;
+	for (auto f = imageFileNames.begin(); f != imageFileNames.end(); ++f)
+	{
+		std::ifstream imageFile(f->c_str(), std::ios::binary);
+		if (!imageFile)
+		{
+			cerr << "Could not open file '" << *f << "'" << endl;
+			return 1;
+		}
+		
+		machines.push_back(Machine(readProgramFromFile(imageFile)));
+	}
+	
+	const auto hashes = runCluster(machines, options, options.roundRobin);
+	if (options.compare &&
+		runCluster(machines, options, !options.roundRobin) != hashes)
+	{
+		cerr << "The results differ" << endl;
+		return 1;
+	}
+	
+	return 0;
+}
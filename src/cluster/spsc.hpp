@@ -0,0 +1,64 @@
+#ifndef DCPUPP_CLUSTER_SPSC_HPP
+#define DCPUPP_CLUSTER_SPSC_HPP
+
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+
+namespace dcpupp
+{
+	//A bounded queue for exactly one producer thread and one consumer thread
+	//which does not need a lock.
+	template <class T, std::size_t Capacity>
+	struct SpscQueue
+	{
+		SpscQueue()
+			: m_head(0)
+			, m_tail(0)
+		{
+		}
+		
+		//producer only, returns false if the queue is full
+		bool push(const T &element)
+		{
+			const auto tail = m_tail.load(std::memory_order_relaxed);
+			if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+			{
+				return false;
+			}
+			
+			m_elements[tail % Capacity] = element;
+			m_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+		
+		//consumer only, returns 0 if the queue is empty
+		const T *front() const
+		{
+			const auto head = m_head.load(std::memory_order_relaxed);
+			if (head == m_tail.load(std::memory_order_acquire))
+			{
+				return 0;
+			}
+			
+			return &m_elements[head % Capacity];
+		}
+		
+		//consumer only, the queue must not be empty
+		void pop()
+		{
+			m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+		
+	private:
+		
+		std::array<T, Capacity> m_elements;
+		std::atomic<std::size_t> m_head;
+		std::atomic<std::size_t> m_tail;
+	};
+}
+
+
+#endif
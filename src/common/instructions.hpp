@@ -0,0 +1,113 @@
+#ifndef DCPUPP_COMMON_INSTRUCTIONS_HPP
+#define DCPUPP_COMMON_INSTRUCTIONS_HPP
+
+
+#include "common/operations.hpp"
+#include "common/types.hpp"
+#include <array>
+
+
+namespace dcpupp
+{
+	//Number of words following the instruction word for each argument type.
+	//Every next word costs one cycle to look up, so this is also the cycle
+	//cost of the argument.
+	static const std::array<unsigned char, 64> ArgumentLengths =
+	{{
+		0, 0, 0, 0, 0, 0, 0, 0, //register
+		0, 0, 0, 0, 0, 0, 0, 0, //[register]
+		1, 1, 1, 1, 1, 1, 1, 1, //[next word + register]
+		0, 0, 0, 0, 0, 0,       //POP, PEEK, PUSH, SP, PC, O
+		1, 1,                   //[next word], next word
+		0, 0, 0, 0, 0, 0, 0, 0, //literal 0x00-0x1f
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0,
+	}};
+	
+	//cycles of the basic operations without the arguments,
+	//IFx take one more cycle if the test fails
+	static const std::array<unsigned char, 16> OperationCycles =
+	{{
+		0, //non-basic, see NonBasicOperationCycles
+		1, //SET
+		2, //ADD
+		2, //SUB
+		2, //MUL
+		3, //DIV
+		3, //MOD
+		2, //SHL
+		2, //SHR
+		1, //AND
+		1, //BOR
+		1, //XOR
+		2, //IFE
+		2, //IFN
+		2, //IFG
+		2, //IFB
+	}};
+	
+	//Reserved operations do nothing, but they take a cycle like every
+	//instruction. Otherwise a program which runs into zeroed memory would
+	//never use up a cycle budget.
+	static const std::array<unsigned char, 64> NonBasicOperationCycles =
+	{{
+		1, 2, //JSR
+		1, //WAIT
+		2, //HYP
+		1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1,
+	}};
+	
+	inline unsigned getArgumentLength(unsigned argument)
+	{
+		return ArgumentLengths[argument];
+	}
+	
+	//every next word of the argument costs a cycle to look up
+	inline unsigned getArgumentCycles(unsigned argument)
+	{
+		return ArgumentLengths[argument];
+	}
+	
+	inline bool isNonBasicInstruction(Word instruction)
+	{
+		return ((instruction & 0x0f) == Op_NonBasic);
+	}
+	
+	//length of an instruction including the next words of its arguments
+	inline Word getInstructionLength(Word instruction)
+	{
+		const unsigned b = (instruction >> 10);
+		if (isNonBasicInstruction(instruction))
+		{
+			return static_cast<Word>(1 + ArgumentLengths[b]);
+		}
+		
+		const unsigned a = ((instruction >> 4) & 0x3f);
+		return static_cast<Word>(1 + ArgumentLengths[a] + ArgumentLengths[b]);
+	}
+	
+	//cycles of an executed instruction excluding the penalty of a failed IFx
+	inline unsigned getInstructionCycles(Word instruction)
+	{
+		const unsigned a = ((instruction >> 4) & 0x3f);
+		const unsigned b = (instruction >> 10);
+		if (isNonBasicInstruction(instruction))
+		{
+			return NonBasicOperationCycles[a] + getArgumentCycles(b);
+		}
+		
+		return OperationCycles[instruction & 0x0f] +
+			getArgumentCycles(a) + getArgumentCycles(b);
+	}
+}
+
+
+#endif
@@ -10,6 +10,11 @@ namespace dcpupp
 	typedef std::uint16_t Word;
 	
 	static const Word MaxWord = 0xffff;
+	
+	enum
+	{
+		UniversalRegisterCount = 8,
+	};
 }
 
 
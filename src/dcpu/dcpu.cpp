@@ -0,0 +1,243 @@
+#include "dcpu.h"
+#include "asm/compiler.hpp"
+#include "asm/errors.hpp"
+#include "emu/machine.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <sstream>
+
+
+using namespace dcpupp;
+
+
+struct dcpu_machine
+{
+	Machine machine;
+	
+	dcpu_machine()
+		: machine(Machine::Memory(MemorySizeInWords))
+	{
+	}
+};
+
+
+namespace
+{
+	bool isValidRange(dcpu_word address, size_t count)
+	{
+		return (count <= static_cast<size_t>(MemorySizeInWords - address));
+	}
+	
+	Word *getRegister(Machine &machine, dcpu_register id)
+	{
+		switch (id)
+		{
+		case DCPU_REGISTER_SP: return &machine.sp;
+		case DCPU_REGISTER_PC: return &machine.pc;
+		case DCPU_REGISTER_O: return &machine.o;
+		default:
+			if (static_cast<unsigned>(id) < UniversalRegisterCount)
+			{
+				return &machine.registers[id];
+			}
+			return 0;
+		}
+	}
+	
+	void copyMessage(const std::string &message, char *destination, size_t capacity)
+	{
+		if (!destination ||
+			capacity == 0)
+		{
+			return;
+		}
+		
+		const auto length = std::min(message.size(), capacity - 1);
+		std::memcpy(destination, message.data(), length);
+		destination[length] = '\0';
+	}
+}
+
+
+dcpu_machine *dcpu_machine_create(void)
+{
+	//the memory of the machine is allocated by its constructor
+	try
+	{
+		return new dcpu_machine;
+	}
+	catch (const std::bad_alloc &)
+	{
+		return 0;
+	}
+}
+
+void dcpu_machine_destroy(dcpu_machine *machine)
+{
+	delete machine;
+}
+
+int dcpu_machine_load(
+	dcpu_machine *machine,
+	const dcpu_word *image,
+	size_t size)
+{
+	if (!machine ||
+		(!image && size) ||
+		size > MemorySizeInWords)
+	{
+		return DCPU_ERROR_INVALID_ARGUMENT;
+	}
+	
+	Machine &m = machine->machine;
+	std::copy(image, image + size, m.memory.begin());
+	std::fill(m.memory.begin() + size, m.memory.end(), 0);
+	m.clearRegisters();
+	m.skipNext = false;
+	m.cycles = 0;
+	m.instructions = 0;
+	return DCPU_OK;
+}
+
+uint64_t dcpu_machine_run(
+	dcpu_machine *machine,
+	uint64_t cycles)
+{
+	if (!machine)
+	{
+		return 0;
+	}
+	
+	return machine->machine.runSlice(cycles);
+}
+
+uint64_t dcpu_machine_get_cycles(const dcpu_machine *machine)
+{
+	return machine ? machine->machine.cycles : 0;
+}
+
+int dcpu_machine_read(
+	const dcpu_machine *machine,
+	dcpu_word address,
+	dcpu_word *destination,
+	size_t count)
+{
+	if (!machine ||
+		(!destination && count) ||
+		!isValidRange(address, count))
+	{
+		return DCPU_ERROR_INVALID_ARGUMENT;
+	}
+	
+	const auto begin = machine->machine.memory.begin() + address;
+	std::copy(begin, begin + count, destination);
+	return DCPU_OK;
+}
+
+int dcpu_machine_write(
+	dcpu_machine *machine,
+	dcpu_word address,
+	const dcpu_word *source,
+	size_t count)
+{
+	if (!machine ||
+		(!source && count) ||
+		!isValidRange(address, count))
+	{
+		return DCPU_ERROR_INVALID_ARGUMENT;
+	}
+	
+	std::copy(source, source + count, machine->machine.memory.begin() + address);
+	return DCPU_OK;
+}
+
+dcpu_word dcpu_machine_get_register(
+	const dcpu_machine *machine,
+	dcpu_register id)
+{
+	if (!machine)
+	{
+		return 0;
+	}
+	
+	const Word * const value = getRegister(
+		const_cast<Machine &>(machine->machine), id);
+	return value ? *value : 0;
+}
+
+void dcpu_machine_set_register(
+	dcpu_machine *machine,
+	dcpu_register id,
+	dcpu_word value)
+{
+	if (!machine)
+	{
+		return;
+	}
+	
+	Word * const destination = getRegister(machine->machine, id);
+	if (destination)
+	{
+		*destination = value;
+	}
+}
+
+int dcpu_assemble(
+	const char *source,
+	size_t source_size,
+	dcpu_word *code,
+	size_t code_capacity,
+	size_t *code_size,
+	char *errors,
+	size_t errors_capacity)
+{
+	if ((!source && source_size) ||
+		(!code && code_capacity) ||
+		!code_size)
+	{
+		return DCPU_ERROR_INVALID_ARGUMENT;
+	}
+	
+	copyMessage(std::string(), errors, errors_capacity);
+	
+	try
+	{
+		const std::string sourceCode(source, source_size);
+		std::ostringstream messages;
+		Scanner scanner(
+			sourceCode.begin(),
+			sourceCode.end());
+		Parser parser(
+			scanner);
+		MemoryBuffer program;
+		ErrorPrinter errorHandler(
+			messages,
+			sourceCode.begin(),
+			sourceCode.end());
+		Compiler compiler(
+			parser,
+			program,
+			errorHandler);
+		
+		if (!compiler.compile())
+		{
+			*code_size = 0;
+			copyMessage(messages.str(), errors, errors_capacity);
+			return DCPU_ERROR_ASSEMBLY;
+		}
+		
+		*code_size = program.size();
+		if (program.size() > code_capacity)
+		{
+			return DCPU_ERROR_BUFFER_TOO_SMALL;
+		}
+		
+		std::copy(program.begin(), program.end(), code);
+		return DCPU_OK;
+	}
+	catch (const std::bad_alloc &)
+	{
+		return DCPU_ERROR_OUT_OF_MEMORY;
+	}
+}
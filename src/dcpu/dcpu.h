@@ -0,0 +1,134 @@
+#ifndef DCPUPP_DCPU_DCPU_H
+#define DCPUPP_DCPU_DCPU_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#if defined(_WIN32) && defined(DCPU_SHARED)
+#	ifdef DCPU_BUILDING_LIBRARY
+#		define DCPU_API __declspec(dllexport)
+#	else
+#		define DCPU_API __declspec(dllimport)
+#	endif
+#elif defined(__GNUC__) && defined(DCPU_BUILDING_LIBRARY)
+#	define DCPU_API __attribute__((visibility("default")))
+#else
+#	define DCPU_API
+#endif
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+C interface of the DCPU-16 emulator and assembler.
+
+Functions which can fail return DCPU_OK or one of the negative error codes.
+No function throws and no function keeps a pointer passed to it.
+*/
+
+typedef uint16_t dcpu_word;
+
+typedef struct dcpu_machine dcpu_machine;
+
+enum
+{
+	DCPU_OK = 0,
+	DCPU_ERROR_INVALID_ARGUMENT = -1,
+	DCPU_ERROR_OUT_OF_MEMORY = -2,
+	DCPU_ERROR_BUFFER_TOO_SMALL = -3,
+	DCPU_ERROR_ASSEMBLY = -4,
+};
+
+enum
+{
+	DCPU_MEMORY_SIZE = 0x10000,
+};
+
+typedef enum dcpu_register
+{
+	DCPU_REGISTER_A,
+	DCPU_REGISTER_B,
+	DCPU_REGISTER_C,
+	DCPU_REGISTER_X,
+	DCPU_REGISTER_Y,
+	DCPU_REGISTER_Z,
+	DCPU_REGISTER_I,
+	DCPU_REGISTER_J,
+	DCPU_REGISTER_SP,
+	DCPU_REGISTER_PC,
+	DCPU_REGISTER_O,
+}
+dcpu_register;
+
+/* returns NULL if out of memory */
+DCPU_API dcpu_machine *dcpu_machine_create(void);
+DCPU_API void dcpu_machine_destroy(dcpu_machine *machine);
+
+/* Resets the machine and copies size words of image to address 0.
+   The rest of the memory is zeroed. */
+DCPU_API int dcpu_machine_load(
+	dcpu_machine *machine,
+	const dcpu_word *image,
+	size_t size);
+
+/* Runs until at least cycles cycles have passed or the machine halts.
+   A machine halts when it waits for an interrupt, which nothing raises
+   here, or when an instruction jumps to itself.
+   Returns the number of cycles which actually passed, which is less than
+   cycles if the machine halted. */
+DCPU_API uint64_t dcpu_machine_run(
+	dcpu_machine *machine,
+	uint64_t cycles);
+
+/* total number of cycles since the last load */
+DCPU_API uint64_t dcpu_machine_get_cycles(const dcpu_machine *machine);
+
+/* Copies count words beginning at address. The range must not go beyond the
+   end of the memory. */
+DCPU_API int dcpu_machine_read(
+	const dcpu_machine *machine,
+	dcpu_word address,
+	dcpu_word *destination,
+	size_t count);
+
+DCPU_API int dcpu_machine_write(
+	dcpu_machine *machine,
+	dcpu_word address,
+	const dcpu_word *source,
+	size_t count);
+
+DCPU_API dcpu_word dcpu_machine_get_register(
+	const dcpu_machine *machine,
+	dcpu_register id);
+
+DCPU_API void dcpu_machine_set_register(
+	dcpu_machine *machine,
+	dcpu_register id,
+	dcpu_word value);
+
+/* Assembles source_size characters of source.
+   *code_size is set to the number of words of the program even if code is
+   too small for it. Then DCPU_ERROR_BUFFER_TOO_SMALL is returned.
+   If the source has errors, DCPU_ERROR_ASSEMBLY is returned and a message
+   for each error is written to errors as a null terminated string.
+   errors may be NULL. */
+DCPU_API int dcpu_assemble(
+	const char *source,
+	size_t source_size,
+	dcpu_word *code,
+	size_t code_capacity,
+	size_t *code_size,
+	char *errors,
+	size_t errors_capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
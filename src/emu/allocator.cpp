@@ -0,0 +1,40 @@
+#include "allocator.hpp"
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+
+namespace dcpupp
+{
+#ifdef WIN32
+	void *allocateMergeable(std::size_t size)
+	{
+		return ::operator new(size);
+	}
+	
+	void freeMergeable(void *block, std::size_t)
+	{
+		::operator delete(block);
+	}
+#else
+	void *allocateMergeable(std::size_t size)
+	{
+		void * const block = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (block == MAP_FAILED)
+		{
+			throw std::bad_alloc();
+		}
+		
+#ifdef MADV_MERGEABLE
+		//fails without KSM in the kernel which only costs the sharing
+		::madvise(block, size, MADV_MERGEABLE);
+#endif
+		return block;
+	}
+	
+	void freeMergeable(void *block, std::size_t size)
+	{
+		::munmap(block, size);
+	}
+#endif
+}
@@ -0,0 +1,117 @@
+#ifndef DCPUPP_EMU_ALLOCATOR_HPP
+#define DCPUPP_EMU_ALLOCATOR_HPP
+
+
+#include <cstddef>
+#include <limits>
+#include <new>
+
+
+namespace dcpupp
+{
+	enum
+	{
+		//smaller blocks come from the heap
+		MinimumMergeableSizeInBytes = 64 * 1024,
+	};
+	
+	//Whole pages of their own which the kernel may merge with identical pages
+	//of other processes or blocks (see KSM on Linux). A merged page is copied
+	//again when it is written to.
+	void *allocateMergeable(std::size_t size);
+	void freeMergeable(void *block, std::size_t size);
+	
+	//Allocates large blocks with allocateMergeable so that the memory of
+	//machines running the same program is shared where it is equal.
+	template <class T>
+	struct MergeableAllocator
+	{
+		typedef T value_type;
+		typedef T *pointer;
+		typedef const T *const_pointer;
+		typedef T &reference;
+		typedef const T &const_reference;
+		typedef std::size_t size_type;
+		typedef std::ptrdiff_t difference_type;
+		
+		template <class U>
+		struct rebind
+		{
+			typedef MergeableAllocator<U> other;
+		};
+		
+		MergeableAllocator()
+		{
+		}
+		
+		template <class U>
+		MergeableAllocator(const MergeableAllocator<U> &)
+		{
+		}
+		
+		pointer address(reference value) const
+		{
+			return &value;
+		}
+		
+		const_pointer address(const_reference value) const
+		{
+			return &value;
+		}
+		
+		pointer allocate(size_type count, const void * = 0)
+		{
+			if (count > max_size())
+			{
+				throw std::bad_alloc();
+			}
+			
+			const auto size = count * sizeof(T);
+			return static_cast<pointer>((size >= MinimumMergeableSizeInBytes) ?
+				allocateMergeable(size) : ::operator new(size));
+		}
+		
+		void deallocate(pointer block, size_type count)
+		{
+			const auto size = count * sizeof(T);
+			if (size >= MinimumMergeableSizeInBytes)
+			{
+				freeMergeable(block, size);
+			}
+			else
+			{
+				::operator delete(block);
+			}
+		}
+		
+		size_type max_size() const
+		{
+			return std::numeric_limits<size_type>::max() / sizeof(T);
+		}
+		
+		void construct(pointer destination, const_reference value)
+		{
+			new (static_cast<void *>(destination)) T(value);
+		}
+		
+		void destroy(pointer destination)
+		{
+			destination->~T();
+		}
+	};
+	
+	template <class T, class U>
+	bool operator == (const MergeableAllocator<T> &, const MergeableAllocator<U> &)
+	{
+		return true;
+	}
+	
+	template <class T, class U>
+	bool operator != (const MergeableAllocator<T> &, const MergeableAllocator<U> &)
+	{
+		return false;
+	}
+}
+
+
+#endif
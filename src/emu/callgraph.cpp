@@ -0,0 +1,162 @@
+#include "callgraph.hpp"
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		//SET PC, POP
+		const Word ReturnInstruction = (Arg_Pop << 10) | (Arg_PC << 4) | Op_Set;
+	}
+	
+	
+	CallGraph::CallGraph(Word entry)
+		: m_cycles(0)
+		, m_callPending(false)
+		, m_returnPending(false)
+	{
+		Frame program;
+		program.entry = entry;
+		program.function = 0;
+		program.returnSlot = MemorySizeInWords;
+		program.returnAddress = 0;
+		program.cyclesAtEntry = 0;
+		push(program);
+	}
+	
+	void CallGraph::onJsr(const Machine &machine, Word to)
+	{
+		//JSR has already pushed the return address
+		m_pendingCall.entry = to;
+		m_pendingCall.function = 0;
+		m_pendingCall.returnSlot = machine.sp;
+		m_pendingCall.returnAddress = machine.memory[machine.sp];
+		m_callPending = true;
+	}
+	
+	void CallGraph::onBranch(const Machine &machine, Word from, Word to)
+	{
+		if (machine.memory[from] != ReturnInstruction)
+		{
+			return;
+		}
+		
+		//POP has already moved SP
+		const Word slot = static_cast<Word>(machine.sp - 1);
+		popAbandoned(slot);
+		
+		const Frame &frame = m_frames.back();
+		if (m_frames.size() > 1 &&
+			frame.returnSlot == slot &&
+			frame.returnAddress == to)
+		{
+			m_returnPending = true;
+		}
+	}
+	
+	void CallGraph::onCycle(unsigned cycles)
+	{
+		m_frames.back().function->exclusiveCycles += cycles;
+		m_cycles += cycles;
+		
+		if (m_returnPending)
+		{
+			pop();
+			m_returnPending = false;
+		}
+		
+		if (m_callPending)
+		{
+			//the new return address has overwritten the ones at and below it
+			popAbandoned(m_pendingCall.returnSlot + 1);
+			m_pendingCall.cyclesAtEntry = m_cycles;
+			push(m_pendingCall);
+			m_callPending = false;
+		}
+	}
+	
+	void CallGraph::finish()
+	{
+		while (!m_frames.empty())
+		{
+			pop();
+		}
+	}
+	
+	void CallGraph::push(const Frame &frame)
+	{
+		Function &function = functions[frame.entry];
+		++function.calls;
+		++m_activations[frame.entry];
+		
+		if (!m_frames.empty())
+		{
+			++m_frames.back().function->callees[frame.entry].count;
+		}
+		
+		m_frames.push_back(frame);
+		m_frames.back().function = &function;
+	}
+	
+	void CallGraph::pop()
+	{
+		const Frame frame = m_frames.back();
+		m_frames.pop_back();
+		
+		const std::uint64_t inclusiveCycles = m_cycles - frame.cyclesAtEntry;
+		
+		//the outermost activation of a recursive function already contains
+		//the inner ones
+		if (--m_activations[frame.entry] == 0)
+		{
+			frame.function->inclusiveCycles += inclusiveCycles;
+		}
+		
+		if (!m_frames.empty())
+		{
+			m_frames.back().function->callees[frame.entry].inclusiveCycles += inclusiveCycles;
+		}
+	}
+	
+	void CallGraph::popAbandoned(unsigned slot)
+	{
+		while (m_frames.size() > 1 &&
+			m_frames.back().returnSlot < slot)
+		{
+			pop();
+		}
+	}
+	
+	void writeCallgrind(
+		std::ostream &out,
+		const CallGraph &graph,
+		const SymbolTable &symbols
+		)
+	{
+		std::uint64_t totalCycles = 0;
+		for (auto f = graph.functions.begin(); f != graph.functions.end(); ++f)
+		{
+			totalCycles += f->second.exclusiveCycles;
+		}
+		
+		out << "version: 1\n"
+			<< "creator: dcpuemu\n"
+			<< "positions: line\n"
+			<< "events: Cycles\n"
+			<< "summary: " << totalCycles << "\n";
+		
+		for (auto f = graph.functions.begin(); f != graph.functions.end(); ++f)
+		{
+			const auto &function = f->second;
+			out << "\nfn=" << symbols.getExactName(f->first) << "\n"
+				<< f->first << ' ' << function.exclusiveCycles << "\n";
+			
+			for (auto c = function.callees.begin(); c != function.callees.end(); ++c)
+			{
+				out << "cfn=" << symbols.getExactName(c->first) << "\n"
+					<< "calls=" << c->second.count << ' ' << c->first << "\n"
+					<< f->first << ' ' << c->second.inclusiveCycles << "\n";
+			}
+		}
+	}
+}
@@ -0,0 +1,93 @@
+#ifndef DCPUPP_EMU_CALLGRAPH_HPP
+#define DCPUPP_EMU_CALLGRAPH_HPP
+
+
+#include "machine.hpp"
+#include "symbols.hpp"
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <vector>
+
+
+namespace dcpupp
+{
+	//Cycles per subroutine of a program, counted on a shadow stack which
+	//follows JSR and SET PC, POP.
+	//
+	//A frame knows where its return address is on the stack. When the
+	//program unwinds the stack by itself, a JSR overwrites the return
+	//addresses of abandoned frames and a return pops past them, so these
+	//frames are closed then. A SET PC, POP which does not return to the
+	//innermost frame is a computed jump and is ignored.
+	struct CallGraph
+	{
+		struct Call
+		{
+			std::uint64_t count;
+			std::uint64_t inclusiveCycles;
+		};
+		
+		struct Function
+		{
+			std::uint64_t calls;
+			std::uint64_t exclusiveCycles;
+			std::uint64_t inclusiveCycles;
+			
+			//by the entry of the callee
+			std::map<Word, Call> callees;
+		};
+		
+		//by the entry, the program itself counts as a function at the PC
+		//where it started
+		std::map<Word, Function> functions;
+		
+		explicit CallGraph(Word entry);
+		
+		//the Context hooks of Machine::run
+		void onJsr(const Machine &machine, Word to);
+		void onBranch(const Machine &machine, Word from, Word to);
+		void onCycle(unsigned cycles);
+		
+		//closes the frames which are still open
+		void finish();
+		
+	private:
+		
+		struct Frame
+		{
+			Word entry;
+			Function *function;
+			
+			//address of the return address, above the stack for the program
+			unsigned returnSlot;
+			Word returnAddress;
+			std::uint64_t cyclesAtEntry;
+		};
+		
+		std::vector<Frame> m_frames;
+		std::map<Word, unsigned> m_activations;
+		std::uint64_t m_cycles;
+		
+		//the cycles of a JSR belong to the caller and those of a return to
+		//the callee, so both take effect after the instruction
+		bool m_callPending;
+		Frame m_pendingCall;
+		bool m_returnPending;
+		
+		void push(const Frame &frame);
+		void pop();
+		void popAbandoned(unsigned slot);
+	};
+	
+	//The callgrind format with cycles as the event and addresses as line
+	//numbers.
+	void writeCallgrind(
+		std::ostream &out,
+		const CallGraph &graph,
+		const SymbolTable &symbols
+		);
+}
+
+
+#endif
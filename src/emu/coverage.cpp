@@ -0,0 +1,92 @@
+#include "coverage.hpp"
+#include <iomanip>
+#include <vector>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		enum
+		{
+			CoverageSizeInBytes = MemorySizeInWords / 8,
+		};
+		
+		bool isInstruction(const SymbolTable::Line &line)
+		{
+			return line.size &&
+				line.statement.compare(0, 6, "(data)") != 0 &&
+				line.statement.compare(0, 8, "RESERVE ") != 0;
+		}
+	}
+	
+	
+	bool mergeCoverage(std::istream &in, Coverage &coverage)
+	{
+		std::vector<char> bytes(CoverageSizeInBytes);
+		if (!in.read(bytes.data(), bytes.size()))
+		{
+			return false;
+		}
+		
+		for (std::size_t address = 0; address < MemorySizeInWords; ++address)
+		{
+			if ((bytes[address / 8] >> (address % 8)) & 1)
+			{
+				coverage.set(address);
+			}
+		}
+		return true;
+	}
+	
+	void writeCoverage(std::ostream &out, const Coverage &coverage)
+	{
+		std::vector<char> bytes(CoverageSizeInBytes);
+		for (std::size_t address = 0; address < MemorySizeInWords; ++address)
+		{
+			if (coverage[address])
+			{
+				bytes[address / 8] |= static_cast<char>(1 << (address % 8));
+			}
+		}
+		out.write(bytes.data(), bytes.size());
+	}
+	
+	CoverageSummary writeListingCoverage(
+		std::ostream &out,
+		const Coverage &coverage,
+		const SymbolTable &symbols
+		)
+	{
+		CoverageSummary summary = {0, 0};
+		
+		for (auto l = symbols.lines.begin(); l != symbols.lines.end(); ++l)
+		{
+			char mark = ' ';
+			if (isInstruction(*l))
+			{
+				++summary.instructionLines;
+				
+				//only the first word of an instruction is marked
+				if (coverage[l->address])
+				{
+					++summary.executedLines;
+					mark = '+';
+				}
+				else
+				{
+					mark = '-';
+				}
+			}
+			
+			out << mark << ' ' << std::hex << std::setw(4) << std::setfill('0') << l->address << std::dec << ' ';
+			if (!l->label.empty())
+			{
+				out << ':' << l->label << ' ';
+			}
+			out << l->statement << '\n';
+		}
+		
+		return summary;
+	}
+}
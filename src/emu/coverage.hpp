@@ -0,0 +1,41 @@
+#ifndef DCPUPP_EMU_COVERAGE_HPP
+#define DCPUPP_EMU_COVERAGE_HPP
+
+
+#include "machine.hpp"
+#include "symbols.hpp"
+#include <bitset>
+#include <istream>
+#include <ostream>
+
+
+namespace dcpupp
+{
+	//The addresses of the instructions which were executed, skipped ones do
+	//not count. In a file the bit of address a is bit a % 8 of byte a / 8.
+	typedef std::bitset<MemorySizeInWords> Coverage;
+	
+	//Adds the addresses in the file to coverage, so that the runs of a test
+	//suite can share a file. Returns false if the file is malformed.
+	bool mergeCoverage(std::istream &in, Coverage &coverage);
+	
+	void writeCoverage(std::ostream &out, const Coverage &coverage);
+	
+	struct CoverageSummary
+	{
+		std::size_t instructionLines;
+		std::size_t executedLines;
+	};
+	
+	//The listing with a mark and the address in front of every line: '+' for an executed
+	//instruction, '-' for one which was never executed and a space for the
+	//other lines like labels and data.
+	CoverageSummary writeListingCoverage(
+		std::ostream &out,
+		const Coverage &coverage,
+		const SymbolTable &symbols
+		);
+}
+
+
+#endif
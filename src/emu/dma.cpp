@@ -0,0 +1,117 @@
+#include "dma.hpp"
+#include "interrupts.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		bool isContiguous(Word begin, Word length)
+		{
+			return (static_cast<unsigned>(begin) + length <= MemorySizeInWords);
+		}
+		
+		void markRange(Machine &machine, Word begin, Word length)
+		{
+			const Word head = static_cast<Word>(std::min<unsigned>(length, MemorySizeInWords - begin));
+			machine.markDirty(begin, head);
+			machine.markDirty(0, length - head);
+		}
+		
+		void copy(Machine &machine, Word source, Word destination, Word length)
+		{
+			Word * const memory = machine.memory.data();
+			if (isContiguous(source, length) &&
+				isContiguous(destination, length))
+			{
+				std::memmove(memory + destination, memory + source, length * sizeof(Word));
+				return;
+			}
+			
+			//rare, so the wrapped parts are not handled one by one
+			std::vector<Word> buffer(length);
+			for (Word i = 0; i < length; ++i)
+			{
+				buffer[i] = memory[static_cast<Word>(source + i)];
+			}
+			for (Word i = 0; i < length; ++i)
+			{
+				memory[static_cast<Word>(destination + i)] = buffer[i];
+			}
+		}
+		
+		void fill(Machine &machine, Word destination, Word length, Word value)
+		{
+			Word * const memory = machine.memory.data();
+			const Word head = static_cast<Word>(std::min<unsigned>(length, MemorySizeInWords - destination));
+			std::fill_n(memory + destination, head, value);
+			std::fill_n(memory, length - head, value);
+		}
+		
+		Word compare(const Machine &machine, Word first, Word second, Word length)
+		{
+			const Word * const memory = machine.memory.data();
+			if (isContiguous(first, length) &&
+				isContiguous(second, length))
+			{
+				return static_cast<Word>(std::mismatch(
+					memory + first, memory + first + length, memory + second).first - (memory + first));
+			}
+			
+			Word equal = 0;
+			while (equal < length &&
+				memory[static_cast<Word>(first + equal)] == memory[static_cast<Word>(second + equal)])
+			{
+				++equal;
+			}
+			return equal;
+		}
+	}
+	
+	bool runDma(Machine &machine)
+	{
+		auto &memory = machine.memory;
+		const Word command = memory[DmaCommand];
+		if (!command)
+		{
+			return false;
+		}
+		
+		const Word source = memory[DmaSource];
+		const Word destination = memory[DmaDestination];
+		const Word length = memory[DmaLength];
+		Word result = length;
+		
+		switch (command)
+		{
+		case DmaMode_Copy:
+			copy(machine, source, destination, length);
+			markRange(machine, destination, length);
+			break;
+			
+		case DmaMode_Fill:
+			fill(machine, destination, length, memory[DmaValue]);
+			markRange(machine, destination, length);
+			break;
+			
+		case DmaMode_Compare:
+			result = compare(machine, source, destination, length);
+			break;
+			
+		default:
+			result = 0;
+			break;
+		}
+		
+		//the transfer may have overwritten the registers of the device
+		memory[DmaResult] = result;
+		memory[DmaCommand] = 0;
+		memory[InterruptPending] |= InterruptLine_Dma;
+		machine.markDirty(DmaCommand, 2);
+		machine.markDirty(InterruptPending);
+		return true;
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef DCPUPP_EMU_DMA_HPP
+#define DCPUPP_EMU_DMA_HPP
+
+
+#include "machine.hpp"
+
+
+namespace dcpupp
+{
+	enum
+	{
+		DmaAddress = 0x9030,
+		DmaSource = DmaAddress + 0,
+		DmaDestination = DmaAddress + 1,
+		DmaLength = DmaAddress + 2,
+		
+		//the word written by DmaMode_Fill
+		DmaValue = DmaAddress + 3,
+		
+		//written by the program to start a transfer, 0 when it is finished
+		DmaCommand = DmaAddress + 4,
+		
+		//words transferred, for DmaMode_Compare the number of equal words
+		//before the first difference
+		DmaResult = DmaAddress + 5,
+	};
+	
+	enum DmaMode
+	{
+		DmaMode_Copy = 1,
+		DmaMode_Fill = 2,
+		DmaMode_Compare = 3,
+	};
+	
+	//Executes the transfer the program has requested in DmaCommand, if any.
+	//Ranges wrap around at the end of the memory like the addresses of
+	//instructions do, overlapping copies behave like memmove. A finished
+	//transfer clears DmaCommand and sets InterruptLine_Dma in
+	//InterruptPending, so the program can WAIT for it.
+	//
+	//The device is not seen by the interpreter, so it has to be called
+	//between instructions or slices. Returns true if there was a transfer.
+	bool runDma(Machine &machine);
+}
+
+
+#endif
@@ -0,0 +1,109 @@
+#include "factory.hpp"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+
+namespace dcpupp
+{
+	MachineFactory::MachineFactory(std::size_t maxPooledBlocks)
+		: m_maxPooledBlocks(maxPooledBlocks)
+	{
+		m_statistics.instantiations = 0;
+		m_statistics.instantiationNanoseconds = 0;
+		m_statistics.allocatedBlocks = 0;
+		m_statistics.reusedBlocks = 0;
+		m_statistics.freedBlocks = 0;
+		m_statistics.pooledBlocks = 0;
+	}
+	
+	MachineFactory::TemplateId MachineFactory::addTemplate(Machine::Memory image)
+	{
+		image.resize(MemorySizeInWords);
+		
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_templates.push_back(std::move(image));
+		return m_templates.size() - 1;
+	}
+	
+	const Machine::Memory &MachineFactory::getTemplate(TemplateId id) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		assert(id < m_templates.size());
+		return m_templates[id];
+	}
+	
+	Machine MachineFactory::create(TemplateId id)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		
+		Machine::Memory memory;
+		const Machine::Memory &image = takeBlock(id, memory);
+		if (memory.empty())
+		{
+			memory = image;
+		}
+		else
+		{
+			std::memcpy(memory.data(), image.data(), image.size() * sizeof(image[0]));
+		}
+		
+		Machine machine(std::move(memory));
+		
+		const auto duration = std::chrono::steady_clock::now() - start;
+		
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_statistics.instantiations;
+		m_statistics.instantiationNanoseconds += static_cast<std::uint64_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+		return machine;
+	}
+	
+	void MachineFactory::recycle(Machine &machine)
+	{
+		Machine::Memory memory;
+		memory.swap(machine.memory);
+		if (memory.size() != MemorySizeInWords)
+		{
+			return;
+		}
+		
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_pool.size() >= m_maxPooledBlocks)
+		{
+			++m_statistics.freedBlocks;
+			return;
+		}
+		
+		m_pool.push_back(std::move(memory));
+	}
+	
+	MachineFactoryStatistics MachineFactory::getStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		MachineFactoryStatistics statistics = m_statistics;
+		statistics.pooledBlocks = m_pool.size();
+		return statistics;
+	}
+	
+	const Machine::Memory &MachineFactory::takeBlock(TemplateId id, Machine::Memory &block)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		assert(id < m_templates.size());
+		
+		if (m_pool.empty())
+		{
+			++m_statistics.allocatedBlocks;
+		}
+		else
+		{
+			++m_statistics.reusedBlocks;
+			block.swap(m_pool.back());
+			m_pool.pop_back();
+		}
+		
+		//templates are never removed and a deque does not move its elements
+		return m_templates[id];
+	}
+}
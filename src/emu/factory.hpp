@@ -0,0 +1,64 @@
+#ifndef DCPUPP_EMU_FACTORY_HPP
+#define DCPUPP_EMU_FACTORY_HPP
+
+
+#include "machine.hpp"
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+
+namespace dcpupp
+{
+	struct MachineFactoryStatistics
+	{
+		std::uint64_t instantiations;
+		std::uint64_t instantiationNanoseconds;
+		
+		//memory blocks which had to be allocated for a new machine
+		std::uint64_t allocatedBlocks;
+		
+		//memory blocks of destroyed machines which were used again
+		std::uint64_t reusedBlocks;
+		
+		//memory blocks which were freed because the pool was full
+		std::uint64_t freedBlocks;
+		
+		std::size_t pooledBlocks;
+	};
+	
+	//Creates machines from preloaded images.
+	//
+	//The memory of a machine which is not needed anymore can be given back
+	//with recycle. The next machine gets that block, so creating a machine
+	//usually is a single copy of the image without any allocation, page
+	//fault or zeroing.
+	struct MachineFactory
+	{
+		typedef std::size_t TemplateId;
+		
+		explicit MachineFactory(std::size_t maxPooledBlocks = 1024);
+		
+		TemplateId addTemplate(Machine::Memory image);
+		const Machine::Memory &getTemplate(TemplateId id) const;
+		
+		Machine create(TemplateId id);
+		void recycle(Machine &machine);
+		
+		MachineFactoryStatistics getStatistics() const;
+		
+	private:
+	
+		const std::size_t m_maxPooledBlocks;
+		std::deque<Machine::Memory> m_templates;
+		mutable std::mutex m_mutex;
+		std::vector<Machine::Memory> m_pool;
+		MachineFactoryStatistics m_statistics;
+		
+		const Machine::Memory &takeBlock(TemplateId id, Machine::Memory &block);
+	};
+}
+
+
+#endif
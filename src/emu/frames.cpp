@@ -0,0 +1,216 @@
+#include "frames.hpp"
+#include <algorithm>
+#include <array>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		//rows from top to bottom, the lowest bit is the leftmost pixel
+		typedef std::array<unsigned char, GlyphHeight> Glyph;
+		
+		const Glyph Font[0x60] =
+		{
+			{{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}}, //space
+			{{0x18, 0x3c, 0x3c, 0x18, 0x18, 0x00, 0x18, 0x00}}, //!
+			{{0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}}, //"
+			{{0x36, 0x36, 0x7f, 0x36, 0x7f, 0x36, 0x36, 0x00}}, //#
+			{{0x0c, 0x3e, 0x03, 0x1e, 0x30, 0x1f, 0x0c, 0x00}}, //$
+			{{0x00, 0x63, 0x33, 0x18, 0x0c, 0x66, 0x63, 0x00}}, //%
+			{{0x1c, 0x36, 0x1c, 0x6e, 0x3b, 0x33, 0x6e, 0x00}}, //&
+			{{0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00}}, //'
+			{{0x18, 0x0c, 0x06, 0x06, 0x06, 0x0c, 0x18, 0x00}}, //(
+			{{0x06, 0x0c, 0x18, 0x18, 0x18, 0x0c, 0x06, 0x00}}, //)
+			{{0x00, 0x66, 0x3c, 0xff, 0x3c, 0x66, 0x00, 0x00}}, //*
+			{{0x00, 0x0c, 0x0c, 0x3f, 0x0c, 0x0c, 0x00, 0x00}}, //+
+			{{0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c, 0x06}}, //,
+			{{0x00, 0x00, 0x00, 0x3f, 0x00, 0x00, 0x00, 0x00}}, //-
+			{{0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c, 0x00}}, //.
+			{{0x60, 0x30, 0x18, 0x0c, 0x06, 0x03, 0x01, 0x00}}, //slash
+			{{0x3e, 0x63, 0x73, 0x7b, 0x6f, 0x67, 0x3e, 0x00}}, //0
+			{{0x0c, 0x0e, 0x0c, 0x0c, 0x0c, 0x0c, 0x3f, 0x00}}, //1
+			{{0x1e, 0x33, 0x30, 0x1c, 0x06, 0x33, 0x3f, 0x00}}, //2
+			{{0x1e, 0x33, 0x30, 0x1c, 0x30, 0x33, 0x1e, 0x00}}, //3
+			{{0x38, 0x3c, 0x36, 0x33, 0x7f, 0x30, 0x78, 0x00}}, //4
+			{{0x3f, 0x03, 0x1f, 0x30, 0x30, 0x33, 0x1e, 0x00}}, //5
+			{{0x1c, 0x06, 0x03, 0x1f, 0x33, 0x33, 0x1e, 0x00}}, //6
+			{{0x3f, 0x33, 0x30, 0x18, 0x0c, 0x0c, 0x0c, 0x00}}, //7
+			{{0x1e, 0x33, 0x33, 0x1e, 0x33, 0x33, 0x1e, 0x00}}, //8
+			{{0x1e, 0x33, 0x33, 0x3e, 0x30, 0x18, 0x0e, 0x00}}, //9
+			{{0x00, 0x0c, 0x0c, 0x00, 0x00, 0x0c, 0x0c, 0x00}}, //:
+			{{0x00, 0x0c, 0x0c, 0x00, 0x00, 0x0c, 0x0c, 0x06}}, //;
+			{{0x18, 0x0c, 0x06, 0x03, 0x06, 0x0c, 0x18, 0x00}}, //<
+			{{0x00, 0x00, 0x3f, 0x00, 0x00, 0x3f, 0x00, 0x00}}, //=
+			{{0x06, 0x0c, 0x18, 0x30, 0x18, 0x0c, 0x06, 0x00}}, //>
+			{{0x1e, 0x33, 0x30, 0x18, 0x0c, 0x00, 0x0c, 0x00}}, //?
+			{{0x3e, 0x63, 0x7b, 0x7b, 0x7b, 0x03, 0x1e, 0x00}}, //@
+			{{0x0c, 0x1e, 0x33, 0x33, 0x3f, 0x33, 0x33, 0x00}}, //A
+			{{0x3f, 0x66, 0x66, 0x3e, 0x66, 0x66, 0x3f, 0x00}}, //B
+			{{0x3c, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3c, 0x00}}, //C
+			{{0x1f, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1f, 0x00}}, //D
+			{{0x7f, 0x46, 0x16, 0x1e, 0x16, 0x46, 0x7f, 0x00}}, //E
+			{{0x7f, 0x46, 0x16, 0x1e, 0x16, 0x06, 0x0f, 0x00}}, //F
+			{{0x3c, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7c, 0x00}}, //G
+			{{0x33, 0x33, 0x33, 0x3f, 0x33, 0x33, 0x33, 0x00}}, //H
+			{{0x1e, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x1e, 0x00}}, //I
+			{{0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1e, 0x00}}, //J
+			{{0x67, 0x66, 0x36, 0x1e, 0x36, 0x66, 0x67, 0x00}}, //K
+			{{0x0f, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7f, 0x00}}, //L
+			{{0x63, 0x77, 0x7f, 0x7f, 0x6b, 0x63, 0x63, 0x00}}, //M
+			{{0x63, 0x67, 0x6f, 0x7b, 0x73, 0x63, 0x63, 0x00}}, //N
+			{{0x1c, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1c, 0x00}}, //O
+			{{0x3f, 0x66, 0x66, 0x3e, 0x06, 0x06, 0x0f, 0x00}}, //P
+			{{0x1e, 0x33, 0x33, 0x33, 0x3b, 0x1e, 0x38, 0x00}}, //Q
+			{{0x3f, 0x66, 0x66, 0x3e, 0x36, 0x66, 0x67, 0x00}}, //R
+			{{0x1e, 0x33, 0x07, 0x0e, 0x38, 0x33, 0x1e, 0x00}}, //S
+			{{0x3f, 0x2d, 0x0c, 0x0c, 0x0c, 0x0c, 0x1e, 0x00}}, //T
+			{{0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3f, 0x00}}, //U
+			{{0x33, 0x33, 0x33, 0x33, 0x33, 0x1e, 0x0c, 0x00}}, //V
+			{{0x63, 0x63, 0x63, 0x6b, 0x7f, 0x77, 0x63, 0x00}}, //W
+			{{0x63, 0x63, 0x36, 0x1c, 0x1c, 0x36, 0x63, 0x00}}, //X
+			{{0x33, 0x33, 0x33, 0x1e, 0x0c, 0x0c, 0x1e, 0x00}}, //Y
+			{{0x7f, 0x63, 0x31, 0x18, 0x4c, 0x66, 0x7f, 0x00}}, //Z
+			{{0x1e, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1e, 0x00}}, //[
+			{{0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0x40, 0x00}}, //backslash
+			{{0x1e, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1e, 0x00}}, //]
+			{{0x08, 0x1c, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00}}, //^
+			{{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff}}, //_
+			{{0x0c, 0x0c, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00}}, //`
+			{{0x00, 0x00, 0x1e, 0x30, 0x3e, 0x33, 0x6e, 0x00}}, //a
+			{{0x07, 0x06, 0x06, 0x3e, 0x66, 0x66, 0x3b, 0x00}}, //b
+			{{0x00, 0x00, 0x1e, 0x33, 0x03, 0x33, 0x1e, 0x00}}, //c
+			{{0x38, 0x30, 0x30, 0x3e, 0x33, 0x33, 0x6e, 0x00}}, //d
+			{{0x00, 0x00, 0x1e, 0x33, 0x3f, 0x03, 0x1e, 0x00}}, //e
+			{{0x1c, 0x36, 0x06, 0x0f, 0x06, 0x06, 0x0f, 0x00}}, //f
+			{{0x00, 0x00, 0x6e, 0x33, 0x33, 0x3e, 0x30, 0x1f}}, //g
+			{{0x07, 0x06, 0x36, 0x6e, 0x66, 0x66, 0x67, 0x00}}, //h
+			{{0x0c, 0x00, 0x0e, 0x0c, 0x0c, 0x0c, 0x1e, 0x00}}, //i
+			{{0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1e}}, //j
+			{{0x07, 0x06, 0x66, 0x36, 0x1e, 0x36, 0x67, 0x00}}, //k
+			{{0x0e, 0x0c, 0x0c, 0x0c, 0x0c, 0x0c, 0x1e, 0x00}}, //l
+			{{0x00, 0x00, 0x33, 0x7f, 0x7f, 0x6b, 0x63, 0x00}}, //m
+			{{0x00, 0x00, 0x1f, 0x33, 0x33, 0x33, 0x33, 0x00}}, //n
+			{{0x00, 0x00, 0x1e, 0x33, 0x33, 0x33, 0x1e, 0x00}}, //o
+			{{0x00, 0x00, 0x3b, 0x66, 0x66, 0x3e, 0x06, 0x0f}}, //p
+			{{0x00, 0x00, 0x6e, 0x33, 0x33, 0x3e, 0x30, 0x78}}, //q
+			{{0x00, 0x00, 0x3b, 0x6e, 0x66, 0x06, 0x0f, 0x00}}, //r
+			{{0x00, 0x00, 0x3e, 0x03, 0x1e, 0x30, 0x1f, 0x00}}, //s
+			{{0x08, 0x0c, 0x3e, 0x0c, 0x0c, 0x2c, 0x18, 0x00}}, //t
+			{{0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6e, 0x00}}, //u
+			{{0x00, 0x00, 0x33, 0x33, 0x33, 0x1e, 0x0c, 0x00}}, //v
+			{{0x00, 0x00, 0x63, 0x6b, 0x7f, 0x7f, 0x36, 0x00}}, //w
+			{{0x00, 0x00, 0x63, 0x36, 0x1c, 0x36, 0x63, 0x00}}, //x
+			{{0x00, 0x00, 0x33, 0x33, 0x33, 0x3e, 0x30, 0x1f}}, //y
+			{{0x00, 0x00, 0x3f, 0x19, 0x0c, 0x26, 0x3f, 0x00}}, //z
+			{{0x38, 0x0c, 0x0c, 0x07, 0x0c, 0x0c, 0x38, 0x00}}, //{
+			{{0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00}}, //|
+			{{0x07, 0x0c, 0x0c, 0x38, 0x0c, 0x0c, 0x07, 0x00}}, //}
+			{{0x6e, 0x3b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}}, //~
+			{{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}}, //DEL
+		};
+		
+		//the bits of a color are intensity, red, green and blue
+		const unsigned char Palette[16][3] =
+		{
+			{0x00, 0x00, 0x00}, {0x00, 0x00, 0xaa}, {0x00, 0xaa, 0x00}, {0x00, 0xaa, 0xaa},
+			{0xaa, 0x00, 0x00}, {0xaa, 0x00, 0xaa}, {0xaa, 0x55, 0x00}, {0xaa, 0xaa, 0xaa},
+			{0x55, 0x55, 0x55}, {0x55, 0x55, 0xff}, {0x55, 0xff, 0x55}, {0x55, 0xff, 0xff},
+			{0xff, 0x55, 0x55}, {0xff, 0x55, 0xff}, {0xff, 0xff, 0x55}, {0xff, 0xff, 0xff},
+		};
+		
+		enum
+		{
+			DefaultForeground = 7,
+			DefaultBackground = 0,
+		};
+	}
+	
+	
+	FrameRenderer::FrameRenderer(Word videoAddress, unsigned width, unsigned height)
+		: m_videoAddress(videoAddress)
+		, m_width(width)
+		, m_height(height)
+		, m_rendered(false)
+		, m_characters(width * height)
+		, m_pixels(width * GlyphWidth * height * GlyphHeight * 3)
+	{
+	}
+	
+	bool FrameRenderer::update(const Machine::Memory &memory)
+	{
+		bool changed = !m_rendered;
+		for (unsigned y = 0; y < m_height; ++y)
+		{
+			for (unsigned x = 0; x < m_width; ++x)
+			{
+				//the video memory wraps around like any other range
+				const Word character = memory[static_cast<Word>(m_videoAddress + y * m_width + x)];
+				Word &previous = m_characters[y * m_width + x];
+				if (m_rendered &&
+					previous == character)
+				{
+					continue;
+				}
+				
+				previous = character;
+				renderCharacter(x, y, character);
+				changed = true;
+			}
+		}
+		
+		m_rendered = true;
+		return changed;
+	}
+	
+	const std::vector<unsigned char> &FrameRenderer::getPixels() const
+	{
+		return m_pixels;
+	}
+	
+	unsigned FrameRenderer::getPixelWidth() const
+	{
+		return m_width * GlyphWidth;
+	}
+	
+	unsigned FrameRenderer::getPixelHeight() const
+	{
+		return m_height * GlyphHeight;
+	}
+	
+	void FrameRenderer::renderCharacter(unsigned x, unsigned y, Word character)
+	{
+		unsigned foreground = (character >> 12);
+		unsigned background = (character >> 8) & 0x0f;
+		if (foreground == 0 &&
+			background == 0)
+		{
+			foreground = DefaultForeground;
+			background = DefaultBackground;
+		}
+		
+		const unsigned code = (character & 0x7f);
+		static const Glyph Empty = {{0}};
+		const Glyph &glyph = (code >= 0x20) ? Font[code - 0x20] : Empty;
+		
+		//each row of the glyph is a run of pixels in the frame
+		const std::size_t stride = getPixelWidth() * 3;
+		unsigned char *row = m_pixels.data() + (y * GlyphHeight * getPixelWidth() + x * GlyphWidth) * 3;
+		for (unsigned gy = 0; gy < GlyphHeight; ++gy, row += stride)
+		{
+			unsigned char *pixel = row;
+			for (unsigned gx = 0; gx < GlyphWidth; ++gx, pixel += 3)
+			{
+				const unsigned char *color = Palette[((glyph[gy] >> gx) & 1) ? foreground : background];
+				std::copy(color, color + 3, pixel);
+			}
+		}
+	}
+	
+	void writeFramePpm(std::ostream &out, const FrameRenderer &frame, std::uint64_t cycles)
+	{
+		out << "P6\n# cycles " << cycles << "\n"
+			<< frame.getPixelWidth() << ' ' << frame.getPixelHeight() << "\n255\n";
+		out.write(reinterpret_cast<const char *>(frame.getPixels().data()), frame.getPixels().size());
+	}
+}
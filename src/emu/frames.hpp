@@ -0,0 +1,52 @@
+#ifndef DCPUPP_EMU_FRAMES_HPP
+#define DCPUPP_EMU_FRAMES_HPP
+
+
+#include "machine.hpp"
+#include <ostream>
+#include <vector>
+
+
+namespace dcpupp
+{
+	enum
+	{
+		GlyphWidth = 8,
+		GlyphHeight = 8,
+	};
+	
+	//Renders the characters of the video memory with a built-in font into
+	//RGB pixels. A character is ffffbbbbBccccccc: foreground and background
+	//color of the 16 CGA colors, blink (ignored) and the ASCII code. A
+	//character without colors is light gray on black like in the terminal.
+	struct FrameRenderer
+	{
+		explicit FrameRenderer(Word videoAddress, unsigned width, unsigned height);
+		
+		//returns false if the video memory has not changed since the last
+		//frame, the pixels stay as they were then
+		bool update(const Machine::Memory &memory);
+		
+		//3 bytes per pixel, rows from top to bottom
+		const std::vector<unsigned char> &getPixels() const;
+		unsigned getPixelWidth() const;
+		unsigned getPixelHeight() const;
+		
+	private:
+		
+		const Word m_videoAddress;
+		const unsigned m_width;
+		const unsigned m_height;
+		bool m_rendered;
+		std::vector<Word> m_characters;
+		std::vector<unsigned char> m_pixels;
+		
+		void renderCharacter(unsigned x, unsigned y, Word character);
+	};
+	
+	//a binary PPM with the cycles in a comment
+	void writeFramePpm(std::ostream &out, const FrameRenderer &frame, std::uint64_t cycles);
+}
+
+
+#endif
@@ -0,0 +1,40 @@
+#include "hash.hpp"
+
+
+namespace dcpupp
+{
+	std::uint64_t hashWords(std::uint64_t hash, const Word *words, std::size_t count)
+	{
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			hash = (hash ^ words[i]) * 1099511628211ULL;
+		}
+		return hash;
+	}
+	
+	std::uint64_t hashValue(std::uint64_t hash, std::uint64_t value)
+	{
+		const Word words[] =
+		{
+			static_cast<Word>(value),
+			static_cast<Word>(value >> 16),
+			static_cast<Word>(value >> 32),
+			static_cast<Word>(value >> 48),
+		};
+		return hashWords(hash, words, 4);
+	}
+	
+	std::uint64_t hashMachine(const Machine &machine)
+	{
+		std::uint64_t hash = HashBasis;
+		hash = hashWords(hash, machine.memory.data(), machine.memory.size());
+		hash = hashWords(hash, machine.registers.data(), machine.registers.size());
+		
+		const Word special[] = {machine.sp, machine.pc, machine.o, machine.skipNext};
+		hash = hashWords(hash, special, 4);
+		
+		//the loop acceleration changes where a slice ends
+		hash = hashValue(hash, machine.accelerateLoops);
+		return hashValue(hash, machine.cycles);
+	}
+}
@@ -0,0 +1,23 @@
+#ifndef DCPUPP_EMU_HASH_HPP
+#define DCPUPP_EMU_HASH_HPP
+
+
+#include "machine.hpp"
+#include <cstddef>
+#include <cstdint>
+
+
+namespace dcpupp
+{
+	//FNV-1a over 16 bit words
+	const std::uint64_t HashBasis = 14695981039346656037ULL;
+	
+	std::uint64_t hashWords(std::uint64_t hash, const Word *words, std::size_t count);
+	std::uint64_t hashValue(std::uint64_t hash, std::uint64_t value);
+	
+	//Hash of everything a machine without input does from now on.
+	std::uint64_t hashMachine(const Machine &machine);
+}
+
+
+#endif
@@ -0,0 +1,239 @@
+#include "heatmap.hpp"
+#include <cmath>
+#include <iomanip>
+#include <limits>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		void increment(MemoryHeatmap::Counter &counter)
+		{
+			if (counter != std::numeric_limits<MemoryHeatmap::Counter>::max())
+			{
+				++counter;
+			}
+		}
+		
+		std::ostream &printAddress(std::ostream &out, unsigned address)
+		{
+			return out << "0x" << std::hex << std::setw(4) << std::setfill('0') << address << std::dec;
+		}
+		
+		//prints the ranges of consecutive words for which isInRegion is true
+		template <class Predicate>
+		void printRegions(std::ostream &out, const char *name, Predicate isInRegion)
+		{
+			std::vector<std::pair<unsigned, unsigned>> regions;
+			unsigned words = 0;
+			for (unsigned address = 0; address < MemorySizeInWords; ++address)
+			{
+				if (!isInRegion(address))
+				{
+					continue;
+				}
+				
+				++words;
+				if (!regions.empty() &&
+					regions.back().second == address)
+				{
+					++regions.back().second;
+				}
+				else
+				{
+					regions.push_back(std::make_pair(address, address + 1));
+				}
+			}
+			
+			out << name << ": " << words << " words in " << regions.size() << " regions\n";
+			for (auto r = regions.begin(); r != regions.end(); ++r)
+			{
+				out << "  ";
+				printAddress(out, r->first) << '-';
+				printAddress(out, r->second - 1) << ' ' << (r->second - r->first) << " words\n";
+			}
+		}
+		
+		unsigned char scale(MemoryHeatmap::Counter count, MemoryHeatmap::Counter max)
+		{
+			if (count == 0)
+			{
+				return 0;
+			}
+			
+			//the least count is still visible
+			return static_cast<unsigned char>(64 + 191 * std::log(static_cast<double>(count)) /
+				std::log(static_cast<double>(max) + 1));
+		}
+	}
+	
+	
+	MemoryHeatmap::MemoryHeatmap(std::uint64_t workingSetInterval)
+		: fetches(MemorySizeInWords)
+		, reads(MemorySizeInWords)
+		, writes(MemorySizeInWords)
+		, workingSets(1)
+		, stackPages(MemoryPageCount)
+		, instructions(0)
+		, m_interval(std::max<std::uint64_t>(workingSetInterval, 1))
+		, m_cyclesInInterval(0)
+		, m_pageIntervals(MemoryPageCount)
+	{
+	}
+	
+	void MemoryHeatmap::onInstruction(const Machine &machine)
+	{
+		//an empty stack at SP 0 is in the last page
+		++stackPages[static_cast<Word>(machine.sp - 1) / MemoryPageSizeInWords];
+		++instructions;
+		
+		const Word length = getInstructionLength(machine.memory[machine.pc]);
+		for (Word i = 0; i < length; ++i)
+		{
+			const Word address = static_cast<Word>(machine.pc + i);
+			increment(fetches[address]);
+			touch(address);
+		}
+	}
+	
+	void MemoryHeatmap::onMemoryRead(Word address)
+	{
+		increment(reads[address]);
+		touch(address);
+	}
+	
+	void MemoryHeatmap::onMemoryWrite(Word address)
+	{
+		increment(writes[address]);
+		touch(address);
+	}
+	
+	void MemoryHeatmap::onWrite(Word address, std::size_t count)
+	{
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			onMemoryWrite(static_cast<Word>(address + i));
+		}
+	}
+	
+	void MemoryHeatmap::onCycle(unsigned cycles)
+	{
+		m_cyclesInInterval += cycles;
+		if (m_cyclesInInterval >= m_interval)
+		{
+			m_cyclesInInterval %= m_interval;
+			workingSets.push_back(0);
+		}
+	}
+	
+	void MemoryHeatmap::touch(Word address)
+	{
+		//the intervals are numbered from 1 so that 0 means never
+		const unsigned interval = static_cast<unsigned>(workingSets.size());
+		unsigned &last = m_pageIntervals[address / MemoryPageSizeInWords];
+		if (last != interval)
+		{
+			last = interval;
+			++workingSets.back();
+		}
+	}
+	
+	void writeHeatmapReport(std::ostream &out, const MemoryHeatmap &heatmap)
+	{
+		printRegions(out, "code", [&heatmap](unsigned address)
+		{
+			return heatmap.fetches[address] != 0;
+		});
+		
+		printRegions(out, "data", [&heatmap](unsigned address)
+		{
+			return !heatmap.fetches[address] &&
+				(heatmap.reads[address] || heatmap.writes[address]);
+		});
+		
+		//the pages where the stack is during at least 1% of the instructions
+		out << "stack pages:\n";
+		for (unsigned page = 0; page < MemoryPageCount; ++page)
+		{
+			const auto count = heatmap.stackPages[page];
+			if (count &&
+				count * 100 >= heatmap.instructions)
+			{
+				out << "  ";
+				printAddress(out, page * MemoryPageSizeInWords) << ' '
+					<< (count * 100 / heatmap.instructions) << "% of the instructions\n";
+			}
+		}
+		
+		//pages which could be shared between machines or left out of
+		//incremental checkpoints
+		std::vector<unsigned> readOnlyPages;
+		unsigned accessedPages = 0;
+		for (unsigned page = 0; page < MemoryPageCount; ++page)
+		{
+			bool accessed = false, written = false;
+			for (unsigned address = page * MemoryPageSizeInWords; address < (page + 1) * MemoryPageSizeInWords; ++address)
+			{
+				accessed = accessed || heatmap.fetches[address] || heatmap.reads[address] || heatmap.writes[address];
+				written = written || heatmap.writes[address];
+			}
+			
+			if (accessed)
+			{
+				++accessedPages;
+				if (!written)
+				{
+					readOnlyPages.push_back(page);
+				}
+			}
+		}
+		
+		out << "pages never written: " << readOnlyPages.size() << " of " << accessedPages << " accessed pages\n";
+		for (auto p = readOnlyPages.begin(); p != readOnlyPages.end(); ++p)
+		{
+			out << "  ";
+			printAddress(out, *p * MemoryPageSizeInWords) << '\n';
+		}
+		
+		const auto &sets = heatmap.workingSets;
+		unsigned maxSet = 0;
+		std::uint64_t totalSet = 0;
+		for (auto s = sets.begin(); s != sets.end(); ++s)
+		{
+			maxSet = std::max(maxSet, *s);
+			totalSet += *s;
+		}
+		
+		out << "working set: " << maxSet << " pages at most, " << (totalSet / sets.size())
+			<< " on average in " << sets.size() << " intervals\n";
+		for (std::size_t i = 0; i < sets.size(); ++i)
+		{
+			out << ((i % 16 == 0) ? "  " : " ") << sets[i];
+			if (i % 16 == 15 ||
+				i + 1 == sets.size())
+			{
+				out << '\n';
+			}
+		}
+	}
+	
+	void writeHeatmapImage(std::ostream &out, const MemoryHeatmap &heatmap)
+	{
+		const auto maxWrites = *std::max_element(heatmap.writes.begin(), heatmap.writes.end());
+		const auto maxReads = *std::max_element(heatmap.reads.begin(), heatmap.reads.end());
+		const auto maxFetches = *std::max_element(heatmap.fetches.begin(), heatmap.fetches.end());
+		
+		out << "P6\n256 256\n255\n";
+		for (unsigned address = 0; address < MemorySizeInWords; ++address)
+		{
+			const char pixel[] =
+			{
+				static_cast<char>(scale(heatmap.writes[address], maxWrites)),
+				static_cast<char>(scale(heatmap.reads[address], maxReads)),
+				static_cast<char>(scale(heatmap.fetches[address], maxFetches)),
+			};
+			out.write(pixel, sizeof(pixel));
+		}
+	}
+}
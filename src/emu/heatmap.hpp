@@ -0,0 +1,67 @@
+#ifndef DCPUPP_EMU_HEATMAP_HPP
+#define DCPUPP_EMU_HEATMAP_HPP
+
+
+#include "machine.hpp"
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+
+namespace dcpupp
+{
+	//Counts how often every word of the memory is fetched as a part of an
+	//instruction, read and written by the arguments of instructions. Writes
+	//of devices and hypercalls are counted when the heatmap is the
+	//writeObserver of the machine, their reads are not. The counters
+	//saturate instead of wrapping around.
+	//
+	//The working set is the number of pages (MemoryPageSizeInWords) which
+	//are accessed in an interval of cycles.
+	struct MemoryHeatmap : IMemoryWriteObserver
+	{
+		typedef std::uint32_t Counter;
+		
+		//one counter per word of the memory each
+		std::vector<Counter> fetches, reads, writes;
+		
+		//pages accessed per interval, the last one may be incomplete
+		std::vector<unsigned> workingSets;
+		
+		//Instructions per page of the top of the stack. Programs can have
+		//several stacks anywhere in the memory, so the pages say more than
+		//the distance from the end of the memory.
+		std::vector<std::uint64_t> stackPages;
+		std::uint64_t instructions;
+		
+		explicit MemoryHeatmap(std::uint64_t workingSetInterval);
+		
+		//the Context hooks of Machine::run
+		void onInstruction(const Machine &machine);
+		void onMemoryRead(Word address);
+		void onMemoryWrite(Word address);
+		void onCycle(unsigned cycles);
+		
+		virtual void onWrite(Word address, std::size_t count);
+		
+	private:
+		
+		const std::uint64_t m_interval;
+		std::uint64_t m_cyclesInInterval;
+		std::vector<unsigned> m_pageIntervals;
+		
+		void touch(Word address);
+	};
+	
+	//Code and data regions, the hot stack pages, pages which were never written
+	//and the working sets.
+	void writeHeatmapReport(std::ostream &out, const MemoryHeatmap &heatmap);
+	
+	//A binary PPM of 256x256 pixels, one for every word from left to right
+	//and top to bottom. Writes are red, reads green and fetches blue on a
+	//logarithmic scale.
+	void writeHeatmapImage(std::ostream &out, const MemoryHeatmap &heatmap);
+}
+
+
+#endif
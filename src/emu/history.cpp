@@ -0,0 +1,390 @@
+#include "history.hpp"
+#include <algorithm>
+#include <cassert>
+
+
+namespace dcpupp
+{
+	struct History::RecordingContext
+	{
+		History &history;
+		Position end;
+		bool watch;
+		Word watchAddress;
+		bool hit;
+		std::size_t nextInput;
+		
+		explicit RecordingContext(History &history, Position end, bool watch, Word watchAddress)
+			: history(history)
+			, end(end)
+			, watch(watch)
+			, watchAddress(watchAddress)
+			, hit(false)
+			, nextInput(history.findNextInput(history.m_position))
+		{
+		}
+		
+		bool startInstruction()
+		{
+			history.applyInputs(history.m_machine, history.m_position, nextInput, true);
+			
+			if (hit ||
+				history.m_position == end)
+			{
+				return false;
+			}
+			
+			if (history.m_position - history.m_checkpoints.back().position >=
+				history.m_interval)
+			{
+				history.takeCheckpoint();
+			}
+			
+			++history.m_position;
+			return true;
+		}
+		
+		void onMemoryWrite(Word address, Word)
+		{
+			history.savePage(address);
+			
+			if (watch &&
+				address == watchAddress)
+			{
+				hit = true;
+			}
+		}
+	};
+	
+	struct History::ReplayContext
+	{
+		History &history;
+		Machine &machine;
+		Position position, end;
+		std::size_t nextInput;
+		Word watchAddress;
+		bool found;
+		Position writer;
+		
+		explicit ReplayContext(History &history, Machine &machine, Position begin, Position end, Word watchAddress)
+			: history(history)
+			, machine(machine)
+			, position(begin)
+			, end(end)
+			, nextInput(history.findFirstInput(begin))
+			, watchAddress(watchAddress)
+			, found(false)
+			, writer(0)
+		{
+		}
+		
+		bool startInstruction()
+		{
+			history.applyInputs(machine, position, nextInput, false);
+			
+			if (position == end)
+			{
+				return false;
+			}
+			
+			++position;
+			return true;
+		}
+		
+		void onMemoryWrite(Word address, Word)
+		{
+			if (address == watchAddress)
+			{
+				found = true;
+				writer = (position - 1);
+			}
+		}
+	};
+	
+	
+	History::History(
+		Machine &machine,
+		unsigned checkpointInterval,
+		std::size_t maxBytes
+		)
+		: m_machine(machine)
+		, m_interval(std::max(checkpointInterval, 1u))
+		, m_maxBytes(maxBytes)
+		, m_bytes(0)
+		, m_position(0)
+	{
+		takeCheckpoint();
+	}
+	
+	History::Position History::getPosition() const
+	{
+		return m_position;
+	}
+	
+	History::Position History::getEarliestPosition() const
+	{
+		return m_checkpoints.front().position;
+	}
+	
+	void History::step(Position count)
+	{
+		run(m_position + count, false, 0);
+	}
+	
+	bool History::reverseStep(Position count)
+	{
+		if (m_position - getEarliestPosition() < count)
+		{
+			return false;
+		}
+		
+		return seek(m_position - count);
+	}
+	
+	bool History::seek(Position position)
+	{
+		if (position < getEarliestPosition())
+		{
+			return false;
+		}
+		
+		if (position < m_position)
+		{
+			std::size_t checkpoint = m_checkpoints.size() - 1;
+			while (m_checkpoints[checkpoint].position > position)
+			{
+				--checkpoint;
+			}
+			
+			restore(checkpoint);
+		}
+		
+		run(position, false, 0);
+		return true;
+	}
+	
+	bool History::continueToWrite(Word address, Position maxCount)
+	{
+		return run(m_position + maxCount, true, address);
+	}
+	
+	bool History::reverseContinueToWrite(Word address)
+	{
+		Position writer;
+		return
+			findLastWrite(address, writer) &&
+			seek(writer);
+	}
+	
+	bool History::findLastWrite(Word address, Position &writer)
+	{
+		const Machine present = m_machine;
+		const unsigned page = (address / HistoryPageSize);
+		bool found = false;
+		
+		for (std::size_t i = m_checkpoints.size(); (i > 0) && !found; )
+		{
+			--i;
+			const Checkpoint &checkpoint = m_checkpoints[i];
+			
+			//m_machine's memory goes back to the state of the checkpoint
+			undo(checkpoint, m_machine);
+			
+			if (!checkpoint.savedPages[page])
+			{
+				continue;
+			}
+			
+			Machine replayed = m_machine;
+			loadRegisters(checkpoint, replayed);
+			
+			const Position end = (i + 1 < m_checkpoints.size()) ?
+				m_checkpoints[i + 1].position : m_position;
+			ReplayContext context(*this, replayed, checkpoint.position, end, address);
+			replayed.run(context);
+			
+			if (context.found)
+			{
+				found = true;
+				writer = context.writer;
+			}
+		}
+		
+		m_machine = present;
+		return found;
+	}
+	
+	void History::injectInput(Word address, Word value)
+	{
+		//the old future does not happen anymore
+		m_inputs.erase(
+			m_inputs.begin() + findNextInput(m_position),
+			m_inputs.end());
+		
+		Input input;
+		input.position = m_position;
+		input.address = address;
+		input.value = value;
+		m_inputs.push_back(input);
+		
+		savePage(address);
+		m_machine.memory[address] = value;
+	}
+	
+	void History::takeCheckpoint()
+	{
+		m_checkpoints.push_back(Checkpoint());
+		Checkpoint &checkpoint = m_checkpoints.back();
+		checkpoint.position = m_position;
+		checkpoint.registers = m_machine.registers;
+		checkpoint.sp = m_machine.sp;
+		checkpoint.pc = m_machine.pc;
+		checkpoint.o = m_machine.o;
+		checkpoint.skipNext = m_machine.skipNext;
+		checkpoint.cycles = m_machine.cycles;
+		checkpoint.instructions = m_machine.instructions;
+		m_bytes += getSize(checkpoint);
+		
+		//the newest checkpoint is always kept
+		if (m_bytes > m_maxBytes &&
+			m_checkpoints.size() > 1)
+		{
+			do
+			{
+				m_bytes -= getSize(m_checkpoints.front());
+				m_checkpoints.pop_front();
+			}
+			while (m_bytes > m_maxBytes &&
+				m_checkpoints.size() > 1);
+			
+			//These are already contained in the state of the oldest checkpoint.
+			//The inputs at its position are not, its saved pages are older.
+			while (!m_inputs.empty() &&
+				m_inputs.front().position < getEarliestPosition())
+			{
+				m_inputs.pop_front();
+			}
+		}
+	}
+	
+	void History::savePage(Word address)
+	{
+		Checkpoint &checkpoint = m_checkpoints.back();
+		const unsigned page = (address / HistoryPageSize);
+		if (checkpoint.savedPages[page])
+		{
+			return;
+		}
+		
+		checkpoint.savedPages[page] = true;
+		checkpoint.pageIds.push_back(page);
+		
+		const auto begin = m_machine.memory.begin() + page * HistoryPageSize;
+		checkpoint.pageContents.insert(
+			checkpoint.pageContents.end(),
+			begin,
+			begin + HistoryPageSize);
+		m_bytes += HistoryPageSize * sizeof(Word) + sizeof(unsigned);
+	}
+	
+	void History::applyInputs(Machine &machine, Position position, std::size_t &nextInput, bool record)
+	{
+		for (; (nextInput < m_inputs.size()) &&
+			(m_inputs[nextInput].position <= position); ++nextInput)
+		{
+			const Input &input = m_inputs[nextInput];
+			if (record)
+			{
+				savePage(input.address);
+			}
+			machine.memory[input.address] = input.value;
+		}
+	}
+	
+	std::size_t History::findNextInput(Position position) const
+	{
+		//the inputs at position are part of the state at position
+		std::size_t i = m_inputs.size();
+		while (i > 0 &&
+			m_inputs[i - 1].position > position)
+		{
+			--i;
+		}
+		return i;
+	}
+	
+	//including the inputs at position
+	std::size_t History::findFirstInput(Position position) const
+	{
+		std::size_t i = findNextInput(position);
+		while (i > 0 &&
+			m_inputs[i - 1].position == position)
+		{
+			--i;
+		}
+		return i;
+	}
+	
+	void History::restore(std::size_t checkpoint)
+	{
+		assert(checkpoint < m_checkpoints.size());
+		
+		while (m_checkpoints.size() > checkpoint + 1)
+		{
+			undo(m_checkpoints.back(), m_machine);
+			m_bytes -= getSize(m_checkpoints.back());
+			m_checkpoints.pop_back();
+		}
+		
+		Checkpoint &target = m_checkpoints.back();
+		undo(target, m_machine);
+		m_bytes -= getSize(target) - sizeof(target);
+		target.savedPages.reset();
+		target.pageIds.clear();
+		target.pageContents.clear();
+		
+		loadRegisters(target, m_machine);
+		m_position = target.position;
+		
+		//the saved pages are from before the inputs at the position of the
+		//checkpoint
+		std::size_t nextInput = findFirstInput(m_position);
+		applyInputs(m_machine, m_position, nextInput, true);
+	}
+	
+	bool History::run(Position end, bool watch, Word watchAddress)
+	{
+		RecordingContext context(*this, end, watch, watchAddress);
+		m_machine.run(context);
+		return context.hit;
+	}
+	
+	void History::undo(const Checkpoint &checkpoint, Machine &machine)
+	{
+		for (std::size_t i = 0; i < checkpoint.pageIds.size(); ++i)
+		{
+			const auto source = checkpoint.pageContents.begin() + i * HistoryPageSize;
+			std::copy(
+				source,
+				source + HistoryPageSize,
+				machine.memory.begin() + checkpoint.pageIds[i] * HistoryPageSize);
+		}
+	}
+	
+	void History::loadRegisters(const Checkpoint &checkpoint, Machine &machine)
+	{
+		machine.registers = checkpoint.registers;
+		machine.sp = checkpoint.sp;
+		machine.pc = checkpoint.pc;
+		machine.o = checkpoint.o;
+		machine.skipNext = checkpoint.skipNext;
+		machine.cycles = checkpoint.cycles;
+		machine.instructions = checkpoint.instructions;
+	}
+	
+	std::size_t History::getSize(const Checkpoint &checkpoint)
+	{
+		return sizeof(checkpoint) +
+			checkpoint.pageIds.size() * (HistoryPageSize * sizeof(Word) + sizeof(unsigned));
+	}
+}
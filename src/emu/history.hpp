@@ -0,0 +1,113 @@
+#ifndef DCPUPP_EMU_HISTORY_HPP
+#define DCPUPP_EMU_HISTORY_HPP
+
+
+#include "machine.hpp"
+#include <bitset>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+
+namespace dcpupp
+{
+	enum
+	{
+		HistoryPageSize = 256,
+		HistoryPageCount = MemorySizeInWords / HistoryPageSize,
+	};
+
+	//Records the execution of a machine so that it can be run backwards.
+	//
+	//Every checkpointInterval instructions a checkpoint with the registers is
+	//taken. The memory is not copied. Instead the old content of a page is
+	//saved when the page is written to for the first time after a checkpoint.
+	//Going back to a checkpoint means putting back these pages, newest first.
+	//Any other position is reached by going back to the checkpoint before it
+	//and executing at most checkpointInterval instructions again.
+	//
+	//Writes from outside of the machine (like keyboard input) have to go
+	//through injectInput so that they are repeated at the same position.
+	//
+	//The oldest checkpoints are dropped when the checkpoints take more than
+	//maxBytes. The newest checkpoint can save every page before that happens,
+	//so the history takes at most maxBytes plus the size of the memory.
+	struct History
+	{
+		typedef std::uint64_t Position;
+
+		explicit History(
+			Machine &machine,
+			unsigned checkpointInterval,
+			std::size_t maxBytes = 64 * 1024 * 1024
+			);
+
+		//number of instructions executed since recording started
+		Position getPosition() const;
+		Position getEarliestPosition() const;
+
+		void step(Position count);
+		bool reverseStep(Position count);
+		bool seek(Position position);
+
+		//Stop after the next instruction which writes to address.
+		bool continueToWrite(Word address, Position maxCount);
+
+		//Go back to just before the last instruction which wrote to address.
+		bool reverseContinueToWrite(Word address);
+
+		//Finds the last instruction before the current position which wrote to
+		//address without changing the current position.
+		bool findLastWrite(Word address, Position &writer);
+
+		void injectInput(Word address, Word value);
+
+	private:
+
+		struct Checkpoint
+		{
+			Position position;
+			Machine::Registers registers;
+			Word sp, pc, o;
+			bool skipNext;
+			std::uint64_t cycles;
+			std::uint64_t instructions;
+			std::bitset<HistoryPageCount> savedPages;
+			std::vector<Word> pageContents;
+			std::vector<unsigned> pageIds;
+		};
+
+		struct Input
+		{
+			Position position;
+			Word address;
+			Word value;
+		};
+
+		struct RecordingContext;
+		struct ReplayContext;
+
+		Machine &m_machine;
+		const unsigned m_interval;
+		const std::size_t m_maxBytes;
+		std::size_t m_bytes;
+		Position m_position;
+		std::deque<Checkpoint> m_checkpoints;
+		std::deque<Input> m_inputs;
+
+		void takeCheckpoint();
+		void savePage(Word address);
+		void applyInputs(Machine &machine, Position position, std::size_t &nextInput, bool record);
+		std::size_t findNextInput(Position position) const;
+		std::size_t findFirstInput(Position position) const;
+		void restore(std::size_t checkpoint);
+		bool run(Position end, bool watch, Word watchAddress);
+
+		static void undo(const Checkpoint &checkpoint, Machine &machine);
+		static void loadRegisters(const Checkpoint &checkpoint, Machine &machine);
+		static std::size_t getSize(const Checkpoint &checkpoint);
+	};
+}
+
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef DCPUPP_EMU_HOOKS_HPP
+#define DCPUPP_EMU_HOOKS_HPP
+
+
+#include "common/types.hpp"
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+
+namespace dcpupp
+{
+	/*
+	Optional member functions of the Context of Machine::run:
+	
+	void onMemoryRead(Word address)
+		an instruction reads a word of memory through one of its arguments
+	void onMemoryWrite(Word address, Word value)
+		a word of memory is about to be changed to value, memory[address]
+		still has the old value
+	void onBranch(Word from, Word to)
+		the instruction at from wrote to PC
+	void onJsr(Word from, Word to)
+		the JSR at from calls to, the return address is already pushed
+	void onSkip(Word address)
+		the instruction at address is skipped after a failed IFx
+	void onCycle(unsigned cycles)
+		cycles have passed since the last call
+	std::uint64_t getCycleLimit() const
+		the cycle count at which the context will stop the machine, accelerated
+		loops are only executed up to it
+	
+	A context only defines the hooks it needs. The call of a hook which is
+	not defined is an empty inline function, so it costs nothing.
+	*/
+	
+	template <class Context>
+	struct HasOnMemoryRead
+	{
+		template <class C>
+		static char test(decltype(std::declval<C &>().onMemoryRead(Word()), void()) *);
+		template <class C>
+		static long test(...);
+		
+		enum
+		{
+			value = (sizeof(test<Context>(0)) == sizeof(char))
+		};
+	};
+	
+	template <class Context>
+	typename std::enable_if<HasOnMemoryRead<Context>::value>::type
+	notifyMemoryRead(Context &context, Word address)
+	{
+		context.onMemoryRead(address);
+	}
+	
+	template <class Context>
+	typename std::enable_if<!HasOnMemoryRead<Context>::value>::type
+	notifyMemoryRead(Context &, Word)
+	{
+	}
+	
+	
+	template <class Context>
+	struct HasOnMemoryWrite
+	{
+		template <class C>
+		static char test(decltype(std::declval<C &>().onMemoryWrite(Word(), Word()), void()) *);
+		template <class C>
+		static long test(...);
+		
+		enum
+		{
+			value = (sizeof(test<Context>(0)) == sizeof(char))
+		};
+	};
+	
+	template <class Context>
+	typename std::enable_if<HasOnMemoryWrite<Context>::value>::type
+	notifyMemoryWrite(Context &context, Word address, Word value)
+	{
+		context.onMemoryWrite(address, value);
+	}
+	
+	template <class Context>
+	typename std::enable_if<!HasOnMemoryWrite<Context>::value>::type
+	notifyMemoryWrite(Context &, Word, Word)
+	{
+	}
+	
+	
+	template <class Context>
+	struct HasOnBranch
+	{
+		template <class C>
+		static char test(decltype(std::declval<C &>().onBranch(Word(), Word()), void()) *);
+		template <class C>
+		static long test(...);
+		
+		enum
+		{
+			value = (sizeof(test<Context>(0)) == sizeof(char))
+		};
+	};
+	
+	template <class Context>
+	typename std::enable_if<HasOnBranch<Context>::value>::type
+	notifyBranch(Context &context, Word from, Word to)
+	{
+		context.onBranch(from, to);
+	}
+	
+	template <class Context>
+	typename std::enable_if<!HasOnBranch<Context>::value>::type
+	notifyBranch(Context &, Word, Word)
+	{
+	}
+	
+	
+	template <class Context>
+	struct HasOnJsr
+	{
+		template <class C>
+		static char test(decltype(std::declval<C &>().onJsr(Word(), Word()), void()) *);
+		template <class C>
+		static long test(...);
+		
+		enum
+		{
+			value = (sizeof(test<Context>(0)) == sizeof(char))
+		};
+	};
+	
+	template <class Context>
+	typename std::enable_if<HasOnJsr<Context>::value>::type
+	notifyJsr(Context &context, Word from, Word to)
+	{
+		context.onJsr(from, to);
+	}
+	
+	template <class Context>
+	typename std::enable_if<!HasOnJsr<Context>::value>::type
+	notifyJsr(Context &, Word, Word)
+	{
+	}
+	
+	
+	template <class Context>
+	struct HasOnSkip
+	{
+		template <class C>
+		static char test(decltype(std::declval<C &>().onSkip(Word()), void()) *);
+		template <class C>
+		static long test(...);
+		
+		enum
+		{
+			value = (sizeof(test<Context>(0)) == sizeof(char))
+		};
+	};
+	
+	template <class Context>
+	typename std::enable_if<HasOnSkip<Context>::value>::type
+	notifySkip(Context &context, Word address)
+	{
+		context.onSkip(address);
+	}
+	
+	template <class Context>
+	typename std::enable_if<!HasOnSkip<Context>::value>::type
+	notifySkip(Context &, Word)
+	{
+	}
+	
+	
+	template <class Context>
+	struct HasOnCycle
+	{
+		template <class C>
+		static char test(decltype(std::declval<C &>().onCycle(unsigned()), void()) *);
+		template <class C>
+		static long test(...);
+		
+		enum
+		{
+			value = (sizeof(test<Context>(0)) == sizeof(char))
+		};
+	};
+	
+	template <class Context>
+	typename std::enable_if<HasOnCycle<Context>::value>::type
+	notifyCycle(Context &context, unsigned cycles)
+	{
+		context.onCycle(cycles);
+	}
+	
+	template <class Context>
+	typename std::enable_if<!HasOnCycle<Context>::value>::type
+	notifyCycle(Context &, unsigned)
+	{
+	}
+	
+	
+	template <class Context>
+	struct HasGetCycleLimit
+	{
+		template <class C>
+		static char test(decltype(std::declval<const C &>().getCycleLimit(), void()) *);
+		template <class C>
+		static long test(...);
+		
+		enum
+		{
+			value = (sizeof(test<Context>(0)) == sizeof(char))
+		};
+	};
+	
+	template <class Context>
+	typename std::enable_if<HasGetCycleLimit<Context>::value, std::uint64_t>::type
+	getCycleLimit(const Context &context)
+	{
+		return context.getCycleLimit();
+	}
+	
+	template <class Context>
+	typename std::enable_if<!HasGetCycleLimit<Context>::value, std::uint64_t>::type
+	getCycleLimit(const Context &)
+	{
+		return std::numeric_limits<std::uint64_t>::max();
+	}
+	
+	
+	//Contexts which observe single instructions or memory accesses cannot
+	//have loops accelerated.
+	template <class Context>
+	struct ObservesInstructions : std::integral_constant<bool,
+		HasOnMemoryRead<Context>::value ||
+		HasOnMemoryWrite<Context>::value ||
+		HasOnBranch<Context>::value ||
+		HasOnJsr<Context>::value ||
+		HasOnSkip<Context>::value>
+	{
+	};
+}
+
+
+#endif
@@ -0,0 +1,108 @@
+#include "hypercalls.hpp"
+#include <chrono>
+#include <mutex>
+#include <string>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		enum
+		{
+			Reg_A, Reg_B, Reg_C,
+		};
+		
+		const Word Failed = 0xffff;
+	}
+	
+	void Hypercalls::call(Machine &machine, Word number) const
+	{
+		if (number >= functions.size() ||
+			!functions[number])
+		{
+			machine.registers[Reg_A] = Failed;
+			return;
+		}
+		
+		functions[number](machine);
+	}
+	
+	Hypercalls createHostHypercalls(
+		std::shared_ptr<std::ostream> log,
+		std::shared_ptr<std::istream> blocks
+		)
+	{
+		Hypercalls hypercalls;
+		hypercalls.functions.resize(Hyp_Time + 1);
+		
+		if (log)
+		{
+			const auto mutex = std::make_shared<std::mutex>();
+			hypercalls.functions[Hyp_Log] = [log, mutex](Machine &machine)
+			{
+				const Word begin = machine.registers[Reg_B];
+				const Word count = machine.registers[Reg_C];
+				
+				std::string text(count, '\0');
+				for (Word i = 0; i < count; ++i)
+				{
+					text[i] = static_cast<char>(machine.memory[static_cast<Word>(begin + i)]);
+				}
+				
+				//the lines of different machines are not mixed up
+				std::lock_guard<std::mutex> lock(*mutex);
+				log->write(text.data(), text.size());
+				log->flush();
+				machine.registers[Reg_A] = (*log) ? count : Failed;
+			};
+		}
+		
+		if (blocks)
+		{
+			const auto mutex = std::make_shared<std::mutex>();
+			hypercalls.functions[Hyp_ReadBlock] = [blocks, mutex](Machine &machine)
+			{
+				const Word block = machine.registers[Reg_A];
+				const Word destination = machine.registers[Reg_B];
+				
+				char bytes[HypercallBlockSizeInWords * 2];
+				std::streamsize read;
+				{
+					std::lock_guard<std::mutex> lock(*mutex);
+					blocks->clear();
+					blocks->seekg(static_cast<std::streamoff>(block) * sizeof(bytes));
+					blocks->read(bytes, sizeof(bytes));
+					read = blocks->gcount();
+				}
+				
+				//an odd length leaves the high byte of the last word 0
+				const Word words = static_cast<Word>((read + 1) / 2);
+				if (read % 2)
+				{
+					bytes[read] = 0;
+				}
+				for (Word i = 0; i < words; ++i)
+				{
+					const Word address = static_cast<Word>(destination + i);
+					machine.memory[address] = static_cast<Word>(
+						static_cast<unsigned char>(bytes[i * 2]) |
+						(static_cast<unsigned char>(bytes[i * 2 + 1]) << 8));
+					machine.markDirty(address);
+				}
+				machine.registers[Reg_A] = words;
+			};
+		}
+		
+		hypercalls.functions[Hyp_Time] = [](Machine &machine)
+		{
+			const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count();
+			machine.registers[Reg_A] = static_cast<Word>(now);
+			machine.registers[Reg_B] = static_cast<Word>(now >> 16);
+			machine.registers[Reg_C] = static_cast<Word>(now >> 32);
+		};
+		
+		return hypercalls;
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef DCPUPP_EMU_HYPERCALLS_HPP
+#define DCPUPP_EMU_HYPERCALLS_HPP
+
+
+#include "machine.hpp"
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+
+namespace dcpupp
+{
+	enum HypercallId
+	{
+		//writes the low bytes of C words at B to the log, A = words written
+		Hyp_Log = 0x00,
+		
+		//reads block A of the block file to B, A = words read
+		Hyp_ReadBlock = 0x01,
+		
+		//C:B:A = milliseconds since 1970-01-01 UTC
+		Hyp_Time = 0x02,
+	};
+	
+	enum
+	{
+		//little endian words
+		HypercallBlockSizeInWords = 256,
+	};
+	
+	//Functions of the host which the program calls with HYP n where n is
+	//the index in the table. They take their arguments from A, B and C and
+	//return results in the same registers. An unknown n sets A to 0xffff.
+	struct Hypercalls
+	{
+		typedef std::function<void (Machine &)> Function;
+		
+		std::vector<Function> functions;
+		
+		void call(Machine &machine, Word number) const;
+	};
+	
+	//The calls of HypercallId. log and blocks may be null, so that the
+	//respective call fails. Can be used by many machines on different
+	//threads at the same time.
+	Hypercalls createHostHypercalls(
+		std::shared_ptr<std::ostream> log,
+		std::shared_ptr<std::istream> blocks
+		);
+}
+
+
+#endif
@@ -0,0 +1,98 @@
+#include "interrupts.hpp"
+#include <chrono>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		std::int64_t getNanoseconds()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+	}
+	
+	InterruptController::InterruptController()
+		: m_lines(0)
+		, m_raisedAt(0)
+		, m_raised(0)
+		, m_delivered(0)
+		, m_totalLatency(0)
+		, m_maxLatency(0)
+	{
+	}
+	
+	void InterruptController::raise(Word lines)
+	{
+		++m_raised;
+		
+		//the latency is measured from the oldest undelivered raise
+		std::int64_t expected = 0;
+		m_raisedAt.compare_exchange_strong(expected, getNanoseconds());
+		
+		m_lines.fetch_or(lines);
+	}
+	
+	bool InterruptController::deliver(Machine &machine)
+	{
+		auto &memory = machine.memory;
+		
+		const Word lines = static_cast<Word>(m_lines.exchange(0));
+		if (lines)
+		{
+			const auto raisedAt = m_raisedAt.exchange(0);
+			if (raisedAt)
+			{
+				const auto latency = static_cast<std::uint64_t>(getNanoseconds() - raisedAt);
+				m_totalLatency += latency;
+				
+				auto max = m_maxLatency.load();
+				while (latency > max &&
+					!m_maxLatency.compare_exchange_weak(max, latency))
+				{
+				}
+			}
+			
+			++m_delivered;
+			memory[InterruptPending] |= lines;
+			machine.markDirty(InterruptPending);
+		}
+		
+		//the next instruction must not be separated from the IF before it
+		if (!memory[InterruptHandler] ||
+			memory[InterruptActive] ||
+			!(memory[InterruptPending] & memory[InterruptMask]) ||
+			machine.skipNext)
+		{
+			return false;
+		}
+		
+		//the lines which call the handler also end a WAIT
+		Word returnAddress = machine.pc;
+		Word waitLines;
+		if (getWaitLines(machine, waitLines) &&
+			(memory[InterruptPending] & memory[InterruptMask] & waitLines))
+		{
+			returnAddress += getInstructionLength(memory[machine.pc]);
+		}
+		
+		--machine.sp;
+		memory[machine.sp] = returnAddress;
+		machine.markDirty(machine.sp);
+		machine.pc = memory[InterruptHandler];
+		memory[InterruptActive] = 1;
+		machine.markDirty(InterruptActive);
+		return true;
+	}
+	
+	InterruptStatistics InterruptController::getStatistics() const
+	{
+		InterruptStatistics statistics;
+		statistics.raised = m_raised;
+		statistics.delivered = m_delivered;
+		statistics.totalLatencyNanoseconds = m_totalLatency;
+		statistics.maxLatencyNanoseconds = m_maxLatency;
+		return statistics;
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef DCPUPP_EMU_INTERRUPTS_HPP
+#define DCPUPP_EMU_INTERRUPTS_HPP
+
+
+#include "machine.hpp"
+#include <atomic>
+#include <cstdint>
+
+
+namespace dcpupp
+{
+	enum
+	{
+		InterruptLine_Keyboard = 1 << 0,
+		InterruptLine_Timer = 1 << 1,
+		InterruptLine_Mailbox = 1 << 2,
+		InterruptLine_Dma = 1 << 3,
+		InterruptLine_Disk = 1 << 4,
+	};
+	
+	struct InterruptStatistics
+	{
+		std::uint64_t raised;
+		std::uint64_t delivered;
+		
+		//from the first raise to the moment the program can see the line
+		std::uint64_t totalLatencyNanoseconds;
+		std::uint64_t maxLatencyNanoseconds;
+	};
+	
+	//Interrupt lines of a machine which can be raised by any thread without a
+	//lock. The lines only reach the program when the thread which runs the
+	//machine calls deliver between two slices.
+	//
+	//deliver ORs the raised lines into InterruptPending. If a pending line is
+	//in InterruptMask, a handler is set and no handler is active, the machine
+	//pushes PC and jumps to the handler as if by JSR and InterruptActive is
+	//set to 1. The handler clears the lines it has handled and InterruptActive
+	//and returns with SET PC, POP. It has to preserve the registers itself.
+	//If the machine waits for one of the lines which caused the call, the
+	//handler returns behind the WAIT.
+	struct InterruptController
+	{
+		InterruptController();
+		
+		void raise(Word lines);
+		
+		//Returns true if the handler was entered.
+		bool deliver(Machine &machine);
+		
+		InterruptStatistics getStatistics() const;
+		
+	private:
+		
+		std::atomic<unsigned> m_lines;
+		std::atomic<std::int64_t> m_raisedAt;
+		std::atomic<std::uint64_t> m_raised;
+		std::atomic<std::uint64_t> m_delivered;
+		std::atomic<std::uint64_t> m_totalLatency;
+		std::atomic<std::uint64_t> m_maxLatency;
+	};
+}
+
+
+#endif
@@ -0,0 +1,20 @@
+#include "keyboard.hpp"
+
+
+namespace dcpupp
+{
+	bool KeyboardQueue::deliver(Machine &machine)
+	{
+		Word &destination = machine.memory[KeyboardAddress];
+		if (keys.empty() ||
+			destination != 0)
+		{
+			return false;
+		}
+		
+		destination = keys.front();
+		keys.pop_front();
+		machine.markDirty(KeyboardAddress);
+		return true;
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef DCPUPP_EMU_KEYBOARD_HPP
+#define DCPUPP_EMU_KEYBOARD_HPP
+
+
+#include "machine.hpp"
+#include <deque>
+
+
+namespace dcpupp
+{
+	enum
+	{
+		KeyboardAddress = 0x9000,
+	};
+	
+	//The program reads the last key from KeyboardAddress and sets the word
+	//back to 0 when it has handled it. Keys typed in the meantime wait here.
+	struct KeyboardQueue
+	{
+		std::deque<Word> keys;
+		
+		//Writes the next key if the program is ready for it.
+		//Returns true if a key was written.
+		bool deliver(Machine &machine);
+	};
+}
+
+
+#endif
@@ -1,11 +1,27 @@
 #include "machine.hpp"
+#include "hypercalls.hpp"
 #include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
 
 
 namespace dcpupp
 {
+	IMemoryWriteObserver::~IMemoryWriteObserver()
+	{
+	}
+	
+	
 	Machine::Machine()
 		: skipNext(false)
+		, cycles(0)
+		, instructions(0)
+		, accelerateLoops(true)
+		, trackDirtyPages(false)
+		, hypercalls(0)
+		, writeObserver(0)
+		, performanceMonitor(false)
 	{
 		clearRegisters();
 	}
@@ -13,6 +29,13 @@ namespace dcpupp
 	Machine::Machine(Memory memory)
 		: memory(std::move(memory))
 		, skipNext(false)
+		, cycles(0)
+		, instructions(0)
+		, accelerateLoops(true)
+		, trackDirtyPages(false)
+		, hypercalls(0)
+		, writeObserver(0)
+		, performanceMonitor(false)
 	{
 		this->memory.resize(MemorySizeInWords);
 		clearRegisters();
@@ -24,6 +47,80 @@ namespace dcpupp
 		registers.fill(0);
 	}
 	
+	void Machine::hypercall(Word number)
+	{
+		if (!hypercalls)
+		{
+			registers[0] = 0xffff;
+			return;
+		}
+		
+		hypercalls->call(*this, number);
+	}
+	
+	void Machine::latchPerformanceCounters()
+	{
+		const auto hostTime = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+		const std::uint64_t counters[] =
+		{
+			cycles,
+			instructions,
+			static_cast<std::uint64_t>(hostTime),
+		};
+		
+		for (std::size_t c = 0; c < 3; ++c)
+		{
+			for (std::size_t w = 0; w < PerformanceCounterSizeInWords; ++w)
+			{
+				const Word address = static_cast<Word>(PerformanceAddress + c * PerformanceCounterSizeInWords + w);
+				memory[address] = static_cast<Word>(counters[c] >> (16 * w));
+			}
+		}
+		markDirty(PerformanceAddress, 3 * PerformanceCounterSizeInWords);
+	}
+	
+	std::uint64_t Machine::runSlice(std::uint64_t cycleBudget)
+	{
+		struct SliceContext
+		{
+			const Machine &machine;
+			std::uint64_t end;
+			unsigned previousPc;
+			
+			explicit SliceContext(const Machine &machine, std::uint64_t end)
+				: machine(machine)
+				, end(end)
+				, previousPc(MemorySizeInWords)
+			{
+			}
+			
+			bool startInstruction()
+			{
+				//Only a jump can leave PC where it was. Spinning in a halt
+				//until the end of the slice would waste the time of the host.
+				if (machine.pc == previousPc &&
+					isHalted(machine))
+				{
+					return false;
+				}
+				previousPc = machine.pc;
+				
+				return (machine.cycles < end);
+			}
+			
+			std::uint64_t getCycleLimit() const
+			{
+				return end;
+			}
+		};
+		
+		const auto begin = cycles;
+		SliceContext context(*this, begin + cycleBudget);
+		run(context);
+		return (cycles - begin);
+	}
+	
 	Word &Machine::getArgument(unsigned argument, Word &sp_)
 	{
 		static std::array<Word, 32> SmallLiterals =
@@ -46,7 +143,7 @@ namespace dcpupp
 			
 		case 0x10: case 0x11: case 0x12: case 0x13:
 		case 0x14: case 0x15: case 0x16: case 0x17:
-			return memory[memory[pc++] + registers[argument - 0x10]];
+			return memory[static_cast<Word>(memory[pc++] + registers[argument - 0x10])];
 			
 		case 0x18:
 			return memory[sp_++];
@@ -80,6 +177,461 @@ namespace dcpupp
 	}
 	
 	
+	bool Machine::getAddress(const Word &word, Word &address) const
+	{
+		if (memory.empty() ||
+			&word < &memory.front() ||
+			&word > &memory.back())
+		{
+			return false;
+		}
+		
+		address = static_cast<Word>(&word - &memory.front());
+		return true;
+	}
+	
+	
+	namespace
+	{
+		struct DecodedInstruction
+		{
+			Word word;
+			unsigned op, a, b;
+			Word aNext, bNext;
+			Word length;
+		};
+		
+		bool decode(const Machine::Memory &memory, unsigned address, DecodedInstruction &instr)
+		{
+			if (address >= memory.size())
+			{
+				return false;
+			}
+			
+			instr.word = memory[address];
+			instr.op = (instr.word & 0x0f);
+			instr.a = ((instr.word >> 4) & 0x3f);
+			instr.b = (instr.word >> 10);
+			instr.length = getInstructionLength(instr.word);
+			
+			if (address + instr.length > memory.size())
+			{
+				return false;
+			}
+			
+			unsigned next = address + 1;
+			if (!isNonBasicInstruction(instr.word) &&
+				getArgumentLength(instr.a))
+			{
+				instr.aNext = memory[next++];
+			}
+			
+			if (getArgumentLength(instr.b))
+			{
+				instr.bNext = memory[next++];
+			}
+			
+			return true;
+		}
+		
+		bool getLiteral(unsigned argument, Word next, Word &value)
+		{
+			if (argument >= 0x20)
+			{
+				value = static_cast<Word>(argument - 0x20);
+				return true;
+			}
+			
+			if (argument == 0x1f)
+			{
+				value = next;
+				return true;
+			}
+			
+			return false;
+		}
+		
+		bool isRegister(unsigned argument)
+		{
+			return (argument < UniversalRegisterCount);
+		}
+		
+		//[register] or [next word + register]
+		bool getIndexedAddress(unsigned argument, Word next, unsigned &reg, Word &offset)
+		{
+			if (argument >= 0x08 && argument <= 0x0f)
+			{
+				reg = argument - 0x08;
+				offset = 0;
+				return true;
+			}
+			
+			if (argument >= 0x10 && argument <= 0x17)
+			{
+				reg = argument - 0x10;
+				offset = next;
+				return true;
+			}
+			
+			return false;
+		}
+		
+		//ADD reg, 1 or SUB reg, 1
+		bool getStep(const DecodedInstruction &instr, unsigned &reg, int &delta)
+		{
+			Word one;
+			if ((instr.op != Op_Add && instr.op != Op_Sub) ||
+				!isRegister(instr.a) ||
+				!getLiteral(instr.b, instr.bNext, one) ||
+				one != 1)
+			{
+				return false;
+			}
+			
+			reg = instr.a;
+			delta = (instr.op == Op_Add) ? 1 : -1;
+			return true;
+		}
+		
+		//The first address of a range which is accessed at
+		//begin, begin + delta, ... (count times).
+		bool getRange(unsigned begin, int delta, unsigned count, unsigned &first)
+		{
+			if (begin >= MemorySizeInWords)
+			{
+				return false;
+			}
+			
+			if (delta > 0)
+			{
+				first = begin;
+				return (begin + count <= MemorySizeInWords);
+			}
+			
+			first = begin - (count - 1);
+			return (begin >= count - 1);
+		}
+		
+		bool overlaps(unsigned first0, unsigned count0, unsigned first1, unsigned count1)
+		{
+			return (first0 < first1 + count1) && (first1 < first0 + count0);
+		}
+		
+		//the value of an argument of the instruction at PC without executing it
+		Word peekArgument(const Machine &machine, unsigned argument, Word next, Word nextPc)
+		{
+			const auto &memory = machine.memory;
+			Word value;
+			unsigned reg;
+			Word offset;
+			
+			if (getLiteral(argument, next, value))
+			{
+				return value;
+			}
+			
+			if (isRegister(argument))
+			{
+				return machine.registers[argument];
+			}
+			
+			if (getIndexedAddress(argument, next, reg, offset))
+			{
+				return memory[static_cast<Word>(machine.registers[reg] + offset)];
+			}
+			
+			switch (argument)
+			{
+			case Arg_Pop:
+			case Arg_Peek: return memory[machine.sp];
+			case Arg_Push: return memory[static_cast<Word>(machine.sp - 1)];
+			case Arg_SP: return machine.sp;
+			case Arg_PC: return nextPc;
+			case Arg_O: return machine.o;
+			default: return memory[next]; //[next word]
+			}
+		}
+	}
+	
+	/*
+	Recognized loops:
+	
+	:loop SET [d + R], src  ; d is optional, src is a literal, a register which
+	                        ; is not stepped or [s + S] with S being stepped
+	      ADD R, 1          ; or SUB
+	      ADD S, 1          ; optional second step of another register
+	      IFN C, limit      ; C is a stepped register, limit a literal or a
+	                        ; register which is not stepped
+	      SET PC, loop
+	*/
+	unsigned Machine::accelerateLoop(std::uint64_t cycleBudget)
+	{
+		enum
+		{
+			MinIterations = 8,
+			MaxSteps = 2,
+		};
+		
+		const unsigned head = pc;
+		DecodedInstruction move, steps[MaxSteps], condition, jump;
+		unsigned stepCount = 0;
+		unsigned address = head;
+		
+		if (!decode(memory, address, move) ||
+			move.op != Op_Set)
+		{
+			return 0;
+		}
+		address += move.length;
+		
+		while (stepCount < MaxSteps &&
+			decode(memory, address, steps[stepCount]) &&
+			(steps[stepCount].op == Op_Add || steps[stepCount].op == Op_Sub))
+		{
+			address += steps[stepCount].length;
+			++stepCount;
+		}
+		
+		if (stepCount == 0 ||
+			!decode(memory, address, condition) ||
+			condition.op != Op_Ifn)
+		{
+			return 0;
+		}
+		address += condition.length;
+		
+		Word target;
+		if (!decode(memory, address, jump) ||
+			jump.op != Op_Set ||
+			jump.a != 0x1c ||
+			!getLiteral(jump.b, jump.bNext, target) ||
+			target != head)
+		{
+			return 0;
+		}
+		address += jump.length;
+		const unsigned codeLength = address - head;
+		
+		std::array<int, UniversalRegisterCount> deltas;
+		deltas.fill(0);
+		unsigned lastStep = 0;
+		
+		for (unsigned i = 0; i < stepCount; ++i)
+		{
+			unsigned reg;
+			int delta;
+			if (!getStep(steps[i], reg, delta) ||
+				deltas[reg] != 0)
+			{
+				return 0;
+			}
+			deltas[reg] = delta;
+			lastStep = reg;
+		}
+		
+		//number of iterations until the condition register reaches the limit
+		if (!isRegister(condition.a) ||
+			deltas[condition.a] == 0)
+		{
+			return 0;
+		}
+		
+		Word limit;
+		if (!getLiteral(condition.b, condition.bNext, limit))
+		{
+			if (!isRegister(condition.b) ||
+				deltas[condition.b] != 0)
+			{
+				return 0;
+			}
+			limit = registers[condition.b];
+		}
+		
+		const Word counter = registers[condition.a];
+		unsigned remaining = static_cast<Word>((deltas[condition.a] > 0) ?
+			(limit - counter) : (counter - limit));
+		if (remaining == 0)
+		{
+			remaining = MemorySizeInWords;
+		}
+		
+		unsigned iterationCycles =
+			getInstructionCycles(move.word) +
+			getInstructionCycles(condition.word) +
+			getInstructionCycles(jump.word);
+		for (unsigned i = 0; i < stepCount; ++i)
+		{
+			iterationCycles += getInstructionCycles(steps[i].word);
+		}
+		
+		//the last iteration is executed by the interpreter, the ones after the
+		//budget, too
+		const unsigned count = static_cast<unsigned>(std::min<std::uint64_t>(
+			remaining - 1, cycleBudget / iterationCycles));
+		if (count < MinIterations)
+		{
+			return 0;
+		}
+		
+		unsigned dstReg;
+		Word dstOffset;
+		if (!getIndexedAddress(move.a, move.aNext, dstReg, dstOffset) ||
+			deltas[dstReg] == 0)
+		{
+			return 0;
+		}
+		
+		const unsigned dstBegin = dstOffset + registers[dstReg];
+		const int dstDelta = deltas[dstReg];
+		unsigned dstFirst;
+		if (!getRange(dstBegin, dstDelta, count, dstFirst) ||
+			overlaps(dstFirst, count, head, codeLength))
+		{
+			return 0;
+		}
+		
+		unsigned srcReg;
+		Word srcOffset, value;
+		if (getIndexedAddress(move.b, move.bNext, srcReg, srcOffset))
+		{
+			const unsigned srcBegin = srcOffset + registers[srcReg];
+			const int srcDelta = deltas[srcReg];
+			unsigned srcFirst;
+			if (srcDelta == 0 ||
+				!getRange(srcBegin, srcDelta, count, srcFirst))
+			{
+				return 0;
+			}
+			
+			Word * const data = memory.data();
+			
+			//memmove gives the same result as copying word by word as long as
+			//a word is not overwritten before being read
+			if (srcDelta == dstDelta &&
+				(!overlaps(dstFirst, count, srcFirst, count) ||
+				((dstDelta > 0) == (dstFirst <= srcFirst))))
+			{
+				std::memmove(data + dstFirst, data + srcFirst, count * sizeof(*data));
+			}
+			else
+			{
+				unsigned dst = dstBegin, src = srcBegin;
+				for (unsigned i = 0; i < count; ++i)
+				{
+					data[dst] = data[src];
+					dst += dstDelta;
+					src += srcDelta;
+				}
+			}
+		}
+		else if (getLiteral(move.b, move.bNext, value) ||
+			(isRegister(move.b) && deltas[move.b] == 0))
+		{
+			if (isRegister(move.b))
+			{
+				value = registers[move.b];
+			}
+			
+			std::fill_n(memory.begin() + dstFirst, count, value);
+		}
+		else
+		{
+			return 0;
+		}
+		
+		markDirty(static_cast<Word>(dstFirst), count);
+		
+		for (unsigned r = 0; r < UniversalRegisterCount; ++r)
+		{
+			registers[r] = static_cast<Word>(registers[r] + deltas[r] * static_cast<int>(count));
+		}
+		
+		//O as the last step left it, for when the slice ends before the
+		//interpreter gets to the last iteration
+		const Word previous = static_cast<Word>(registers[lastStep] - deltas[lastStep]);
+		if (deltas[lastStep] > 0)
+		{
+			o = (previous + 1 > MaxWord);
+		}
+		else
+		{
+			o = (previous - 1 > MaxWord) ? MaxWord : 0;
+		}
+		
+		instructions += (3 + stepCount) * count;
+		return iterationCycles * count;
+	}
+	
+	
+	bool getWaitLines(const Machine &machine, Word &lines)
+	{
+		const auto &memory = machine.memory;
+		if (machine.skipNext ||
+			memory.empty())
+		{
+			return false;
+		}
+		
+		const Word instr = memory[machine.pc];
+		if (!isNonBasicInstruction(instr) ||
+			((instr >> 4) & 0x3f) != NBOp_Wait)
+		{
+			return false;
+		}
+		
+		const Word next = memory[static_cast<Word>(machine.pc + 1)];
+		const Word nextPc = static_cast<Word>(machine.pc + getInstructionLength(instr));
+		lines = getWaitLines(peekArgument(machine, instr >> 10, next, nextPc));
+		return true;
+	}
+	
+	bool isWaiting(const Machine &machine)
+	{
+		Word lines;
+		return getWaitLines(machine, lines) &&
+			!(machine.memory[InterruptPending] & lines);
+	}
+	
+	bool isHalted(const Machine &machine)
+	{
+		if (machine.skipNext ||
+			machine.memory.empty())
+		{
+			return false;
+		}
+		
+		if (isWaiting(machine))
+		{
+			return true;
+		}
+		
+		const Word instr = machine.memory[machine.pc];
+		const unsigned op = (instr & 0x0f);
+		const unsigned a = ((instr >> 4) & 0x3f);
+		const unsigned b = (instr >> 10);
+		if (a != Arg_PC)
+		{
+			return false;
+		}
+		
+		//SET PC, <address of this instruction>
+		if (op == Op_Set)
+		{
+			if (b == Arg_Word)
+			{
+				return (machine.memory[static_cast<Word>(machine.pc + 1)] == machine.pc);
+			}
+			
+			return (b >= Arg_SmallLiteral) &&
+				(b - Arg_SmallLiteral == machine.pc);
+		}
+		
+		//SUB PC, 1
+		return (op == Op_Sub) &&
+			(b == Arg_SmallLiteral + 1);
+	}
+	
+	
 	Machine::Memory readProgramFromFile(
 		std::istream &file
 		)
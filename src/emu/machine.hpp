@@ -2,39 +2,149 @@
 #define DCPUPP_EMU_MACHINE_HPP
 
 
+#include "common/instructions.hpp"
 #include "common/operations.hpp"
 #include "common/types.hpp"
+#include "allocator.hpp"
+#include "hooks.hpp"
 #include <array>
+#include <bitset>
 #include <vector>
+#include <algorithm>
 #include <istream>
+#include <cstdint>
 
 
 namespace dcpupp
 {
 	enum
 	{
-		UniversalRegisterCount = 8,
 		MemorySizeInWords = 0x10000,
+		MemoryPageSizeInWords = 256,
+		MemoryPageCount = MemorySizeInWords / MemoryPageSizeInWords,
+	};
+	
+	//memory mapped registers of the interrupt controller (see
+	//InterruptController)
+	enum
+	{
+		InterruptAddress = 0x9010,
+		
+		//address of the handler, 0 if interrupts are not delivered
+		InterruptHandler = InterruptAddress + 0,
+		
+		//lines which were raised and not yet cleared by the program
+		InterruptPending = InterruptAddress + 1,
+		
+		//lines for which the handler is called
+		InterruptMask = InterruptAddress + 2,
+		
+		//not 0 while the handler runs
+		InterruptActive = InterruptAddress + 3,
+	};
+	
+	//memory mapped registers of the performance monitor (see
+	//Machine::performanceMonitor), counters of 48 bit with the lowest word
+	//first
+	enum
+	{
+		PerformanceAddress = 0x9050,
+		
+		//reading the lowest word of the cycles latches all counters
+		PerformanceCycles = PerformanceAddress + 0,
+		
+		PerformanceInstructions = PerformanceAddress + 3,
+		
+		//microseconds of a monotonic clock of the host
+		PerformanceHostTime = PerformanceAddress + 6,
+		
+		PerformanceCounterSizeInWords = 3,
+	};
+	
+	//WAIT a waits for the interrupt lines in a, 0 stands for all lines
+	inline Word getWaitLines(Word argument)
+	{
+		return argument ? argument : 0xffff;
+	}
+	
+	struct Hypercalls;
+	
+	//Is told about the writes to memory which the Context of Machine::run
+	//does not see: devices, hypercalls, interrupts and accelerated loops.
+	struct IMemoryWriteObserver
+	{
+		virtual ~IMemoryWriteObserver();
+		virtual void onWrite(Word address, std::size_t count) = 0;
 	};
 	
 	struct Machine
 	{
 		typedef std::array<Word, UniversalRegisterCount> Registers;
-		typedef std::vector<Word> Memory;
+		typedef std::vector<Word, MergeableAllocator<Word>> Memory;
+		typedef std::bitset<MemoryPageCount> PageSet;
 		
 		Registers registers;
 		Word sp, pc, o;
 		Memory memory;
 		bool skipNext;
+		std::uint64_t cycles;
+		
+		//executed instructions including the accelerated ones, but not the
+		//skipped ones
+		std::uint64_t instructions;
+		
+		bool accelerateLoops;
+		
+		//The pages written to since dirtyPages was cleared. Only maintained
+		//if trackDirtyPages is set.
+		bool trackDirtyPages;
+		PageSet dirtyPages;
+		
+		//the functions which HYP calls, none if null
+		const Hypercalls *hypercalls;
+		
+		//told about every markDirty, none if null
+		IMemoryWriteObserver *writeObserver;
+		
+		//If set, an instruction which reads PerformanceCycles first copies
+		//the counters to the registers of the performance monitor.
+		bool performanceMonitor;
 		
 		Machine();
 		explicit Machine(Memory memory);
 		void clearRegisters();
 		
+		//has to be called after writing to memory from outside of run
+		void markDirty(Word address, std::size_t count = 1);
+		
+		void hypercall(Word number);
+		void latchPerformanceCounters();
+		
 		template <class Context>
 		void run(Context &context);
 		
+		//Runs until at least cycleBudget cycles have passed or the machine
+		//halts (see isHalted) and returns the number of cycles which actually
+		//passed.
+		std::uint64_t runSlice(std::uint64_t cycleBudget);
+		
 		Word &getArgument(unsigned argument, Word &sp_);
+		bool getAddress(const Word &word, Word &address) const;
+		
+		template <class Context>
+		void notifyRead(Context &context, const Word &source) const;
+		template <class Context>
+		void store(Context &context, Word &destination, Word value, Word from);
+		
+		//Called after a jump. If PC points to a recognized fill or copy loop,
+		//all but the last iteration are executed at once. The last one is left
+		//to the interpreter so that O, PC and skipNext end up exactly as if the
+		//loop had been stepped through. O is also left as by the last step in
+		//case the slice ends before the last iteration.
+		//Returns the number of cycles of the accelerated iterations, which are
+		//never more than cycleBudget. The context is not notified about these
+		//instructions.
+		unsigned accelerateLoop(std::uint64_t cycleBudget);
 	};
 	
 	/*
@@ -56,12 +166,78 @@ namespace dcpupp
 	0xf: IFB a, b - performs next instruction only if (a&b)!=0
 	*/
 
+	inline void Machine::markDirty(Word address, std::size_t count)
+	{
+		if (writeObserver &&
+			count != 0)
+		{
+			writeObserver->onWrite(address, count);
+		}
+		
+		if (!trackDirtyPages ||
+			count == 0)
+		{
+			return;
+		}
+		
+		const std::size_t last = std::min<std::size_t>(address + count, MemorySizeInWords) - 1;
+		for (std::size_t page = address / MemoryPageSizeInWords; page <= last / MemoryPageSizeInWords; ++page)
+		{
+			dirtyPages.set(page);
+		}
+	}
+	
+	template <class Context>
+	void Machine::notifyRead(Context &context, const Word &source) const
+	{
+		Word address;
+		if (HasOnMemoryRead<Context>::value &&
+			getAddress(source, address))
+		{
+			notifyMemoryRead(context, address);
+		}
+	}
+	
+	template <class Context>
+	void Machine::store(Context &context, Word &destination, Word value, Word from)
+	{
+		Word address;
+		if ((HasOnMemoryWrite<Context>::value || trackDirtyPages) &&
+			getAddress(destination, address))
+		{
+			//the context has seen the write, so no markDirty
+			notifyMemoryWrite(context, address, value);
+			if (trackDirtyPages)
+			{
+				dirtyPages.set(address / MemoryPageSizeInWords);
+			}
+		}
+		
+		if (HasOnBranch<Context>::value &&
+			&destination == &pc)
+		{
+			notifyBranch(context, from, value);
+		}
+		
+		destination = value;
+	}
+	
 	template <class Context>
 	void Machine::run(Context &context)
 	{
-		next_instruction: while (context.startInstruction())
+		while (context.startInstruction())
 		{
+			const Word from = pc;
 			const auto instr = memory[pc++];
+			
+			if (skipNext)
+			{
+				skipNext = false;
+				pc += getInstructionLength(instr) - 1;
+				notifySkip(context, from);
+				continue;
+			}
+			
 			const auto a = (instr >> 4) & 0x3f;
 			const bool isAWriteable = (a < 0x1f);
 			const auto op = (instr & 0x0f);
@@ -71,17 +247,27 @@ namespace dcpupp
 			if (op != Op_NonBasic)
 			{
 				a_ref = &getArgument(a, savedSp);
+				if (op != Op_Set)
+				{
+					notifyRead(context, *a_ref);
+				}
 			}
 			
 			b_ref = &getArgument(instr >> 10, savedSp);
+			notifyRead(context, *b_ref);
+			sp = savedSp;
 			
-			if (skipNext)
+			if (performanceMonitor)
 			{
-				skipNext = false;
-				goto next_instruction;
+				const Word * const latch = &memory[PerformanceCycles];
+				if (b_ref == latch ||
+					(op != Op_NonBasic && op != Op_Set && a_ref == latch))
+				{
+					latchPerformanceCounters();
+				}
 			}
-			
-			sp = savedSp;
+
+			unsigned instructionCycles = getInstructionCycles(instr);
 			
 			switch (op)
 			{
@@ -90,8 +276,24 @@ namespace dcpupp
 					switch (a)
 					{
 					case NBOp_Jsr: //JSR
-						memory[--sp] = pc;
+						--sp;
+						store(context, memory[sp], pc, from);
 						pc = *b_ref;
+						notifyJsr(context, from, pc);
+						break;
+						
+					case NBOp_Wait: //WAIT
+						//executed again until one of the lines is pending
+						if (!(memory[InterruptPending] & getWaitLines(*b_ref)))
+						{
+							pc = from;
+							if (instr >> 10 == Arg_Pop) --sp;
+							if (instr >> 10 == Arg_Push) ++sp;
+						}
+						break;
+						
+					case NBOp_Hyp: //HYP
+						hypercall(*b_ref);
 						break;
 						
 					default:
@@ -104,7 +306,18 @@ namespace dcpupp
 				{
 					if (isAWriteable)
 					{
-						*a_ref = *b_ref;
+						store(context, *a_ref, *b_ref, from);
+					}
+					
+					if (a == Arg_PC &&
+						accelerateLoops &&
+						!ObservesInstructions<Context>::value)
+					{
+						//the remaining iterations are interpreted when the
+						//context stops earlier
+						const auto limit = getCycleLimit(context);
+						const auto end = cycles + instructionCycles;
+						instructionCycles += accelerateLoop((limit > end) ? (limit - end) : 0);
 					}
 					break;
 				}
@@ -115,7 +328,7 @@ namespace dcpupp
 					o = (result > MaxWord);
 					if (isAWriteable)
 					{
-						*a_ref = static_cast<Word>(result);
+						store(context, *a_ref, static_cast<Word>(result), from);
 					}
 					break;
 				}
@@ -126,7 +339,7 @@ namespace dcpupp
 					o = (result > MaxWord) ? MaxWord : 0;
 					if (isAWriteable)
 					{
-						*a_ref = static_cast<Word>(result);
+						store(context, *a_ref, static_cast<Word>(result), from);
 					}
 					break;
 				}
@@ -137,7 +350,7 @@ namespace dcpupp
 					o = (result >> 16);
 					if (isAWriteable)
 					{
-						*a_ref = static_cast<Word>(result);
+						store(context, *a_ref, static_cast<Word>(result), from);
 					}
 					break;
 				}
@@ -156,7 +369,7 @@ namespace dcpupp
 					}
 					if (isAWriteable)
 					{
-						*a_ref = static_cast<Word>(result);
+						store(context, *a_ref, static_cast<Word>(result), from);
 					}
 					break;
 				}
@@ -167,11 +380,11 @@ namespace dcpupp
 					{
 						if (*b_ref == 0)
 						{
-							*a_ref = 0;
+							store(context, *a_ref, 0, from);
 						}
 						else
 						{
-							*a_ref %= *b_ref;
+							store(context, *a_ref, *a_ref % *b_ref, from);
 						}
 					}
 					break;
@@ -183,7 +396,7 @@ namespace dcpupp
 					o = (result >> 16);
 					if (isAWriteable)
 					{
-						*a_ref = static_cast<Word>(result);
+						store(context, *a_ref, static_cast<Word>(result), from);
 					}
 					break;
 				}
@@ -194,7 +407,7 @@ namespace dcpupp
 					o = ((*a_ref << 16) >> *b_ref);
 					if (isAWriteable)
 					{
-						*a_ref = static_cast<Word>(result);
+						store(context, *a_ref, static_cast<Word>(result), from);
 					}
 					break;
 				}
@@ -203,7 +416,7 @@ namespace dcpupp
 				{
 					if (isAWriteable)
 					{
-						*a_ref &= *b_ref;
+						store(context, *a_ref, *a_ref & *b_ref, from);
 					}
 					break;
 				}
@@ -212,7 +425,7 @@ namespace dcpupp
 				{
 					if (isAWriteable)
 					{
-						*a_ref |= *b_ref;
+						store(context, *a_ref, *a_ref | *b_ref, from);
 					}
 					break;
 				}
@@ -221,7 +434,7 @@ namespace dcpupp
 				{
 					if (isAWriteable)
 					{
-						*a_ref ^= *b_ref;
+						store(context, *a_ref, *a_ref ^ *b_ref, from);
 					}
 					break;
 				}
@@ -262,9 +475,29 @@ namespace dcpupp
 					break;
 				}
 			}
+			
+			//a failed test costs one more cycle
+			if (skipNext)
+			{
+				++instructionCycles;
+			}
+			
+			cycles += instructionCycles;
+			++instructions;
+			notifyCycle(context, instructionCycles);
 		}
 	}
 	
+	//true if PC is at a WAIT, lines are the ones it waits for
+	bool getWaitLines(const Machine &machine, Word &lines);
+	
+	//true if the machine is at a WAIT and none of its lines is pending
+	bool isWaiting(const Machine &machine);
+	
+	//true if the machine is in an endless loop of a single instruction like
+	//"SET PC, <this instruction>" or "SUB PC, 1" or waits (see isWaiting)
+	bool isHalted(const Machine &machine);
+	
 	Machine::Memory readProgramFromFile(
 		std::istream &file
 		);
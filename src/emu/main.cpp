@@ -3,14 +3,62 @@
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <sstream>
 #include "machine.hpp"
+#include "callgraph.hpp"
+#include "coverage.hpp"
+#include "dma.hpp"
+#include "frames.hpp"
+#include "heatmap.hpp"
+#include "history.hpp"
+#include "hypercalls.hpp"
+#include "interrupts.hpp"
+#include "persistence.hpp"
+#include "profiler.hpp"
+#include "script.hpp"
+#include <csignal>
 #ifdef WIN32
 #include <Windows.h>
 #include <conio.h>
+#else
+#include <sys/time.h>
+#include <unistd.h>
 #endif
 using namespace std;
 using namespace dcpupp;
 
+static volatile std::sig_atomic_t stopRequested = 0;
+
+static void requestStop(int)
+{
+	stopRequested = 1;
+}
+
+//set by the profiling timer, the sample is taken before the next instruction
+static volatile std::sig_atomic_t sampleRequested = 0;
+
+static void requestSample(int)
+{
+	sampleRequested = 1;
+}
+
+//sleeps until a signal handler requests the stop
+static void waitForStop()
+{
+	while (!stopRequested)
+	{
+#ifdef WIN32
+		Sleep(1000);
+#else
+		pause();
+#endif
+	}
+}
+
 static void printHelp()
 {
 	cout << "" << endl;
@@ -23,6 +71,24 @@ struct Options
 	unsigned updateInterval;
 	unsigned consoleWidth;
 	unsigned consoleHeight;
+	bool accelerateLoops;
+	unsigned historyInterval;
+	std::string machineFileName;
+	std::string logFileName;
+	std::string blockFileName;
+	bool dma;
+	bool performanceMonitor;
+	std::string profileFileName;
+	unsigned sampleRate;
+	std::string callGraphFileName;
+	std::string heatmapReportFileName;
+	std::string heatmapImageFileName;
+	std::uint64_t workingSetInterval;
+	std::string coverageFileName;
+	std::string listingCoverageFileName;
+	std::string framePrefix;
+	std::string rawFrameFileName;
+	std::string inputScriptFileName;
 	
 	Options()
 		: sleepMs(10)
@@ -30,10 +96,189 @@ struct Options
 		, updateInterval(5)
 		, consoleWidth(32)
 		, consoleHeight(12)
+		, accelerateLoops(true)
+		, historyInterval(0)
+		, dma(false)
+		, performanceMonitor(false)
+		, sampleRate(1000)
+		, workingSetInterval(100000)
 	{
 	}
 };
 
+//Replaces the terminal output with frames of the video memory, a PPM file
+//<prefix>000001.ppm and so on and/or raw RGB frames for a video encoder.
+//Only frames which differ from the previous one are written.
+struct FrameCapture
+{
+	explicit FrameCapture(const Options &options, std::ostream *raw)
+		: renderer(static_cast<Word>(options.videoAddress), options.consoleWidth, options.consoleHeight)
+		, prefix(options.framePrefix)
+		, raw(raw)
+		, frameCount(0)
+	{
+	}
+	
+	void capture(const Machine &machine)
+	{
+		if (!renderer.update(machine.memory))
+		{
+			return;
+		}
+		
+		++frameCount;
+		
+		if (!prefix.empty())
+		{
+			char number[16];
+			sprintf(number, "%06u", frameCount);
+			const std::string fileName = prefix + number + ".ppm";
+			std::ofstream file(fileName.c_str(), std::ios::binary);
+			writeFramePpm(file, renderer, machine.cycles);
+			
+			//the following frames would most likely fail, too
+			if (!file)
+			{
+				cerr << "Could not write frame '" << fileName << "'" << endl;
+				prefix.clear();
+			}
+		}
+		
+		if (raw)
+		{
+			const auto &pixels = renderer.getPixels();
+			raw->write(reinterpret_cast<const char *>(pixels.data()), pixels.size());
+		}
+	}
+	
+private:
+	
+	FrameRenderer renderer;
+	
+	//empty after a frame could not be written
+	std::string prefix;
+	std::ostream * const raw;
+	unsigned frameCount;
+};
+
+static bool parseHex(std::istream &in, unsigned &value)
+{
+	return !!(in >> std::hex >> value >> std::dec);
+}
+
+/*
+Commands of the time travel debugger, numbers are decimal, addresses hex:
+	s [n]         step n instructions
+	b [n]         step n instructions backwards
+	g position    go to an instruction position
+	c address     continue until address is written
+	r address     go back to the last write to address
+	w address     show which instruction last wrote to address
+	i address value
+	              write value to address as input
+	q             quit
+The history keeps about 64 MiB of saved pages, older positions are forgotten.
+*/
+static void runDebugger(
+	Machine &machine,
+	const Options &options,
+	const std::function<void ()> &printInfo)
+{
+	History history(machine, options.historyInterval);
+	std::string message;
+	
+	for (;;)
+	{
+		printInfo();
+		printf("Position: %llu (earliest %llu), cycles: %llu\n",
+			static_cast<unsigned long long>(history.getPosition()),
+			static_cast<unsigned long long>(history.getEarliestPosition()),
+			static_cast<unsigned long long>(machine.cycles));
+		if (!message.empty())
+		{
+			puts(message.c_str());
+			message.clear();
+		}
+		fputs("> ", stdout);
+		fflush(stdout);
+		
+		std::string line;
+		if (!std::getline(std::cin, line))
+		{
+			return;
+		}
+		
+		std::istringstream command(line);
+		std::string name;
+		command >> name;
+		
+		unsigned long long count = 1;
+		unsigned address, value;
+		
+		if (name == "s")
+		{
+			command >> count;
+			history.step(count);
+		}
+		else if (name == "b")
+		{
+			command >> count;
+			if (!history.reverseStep(count))
+			{
+				message = "Cannot go back that far";
+			}
+		}
+		else if (name == "g" && (command >> count))
+		{
+			if (!history.seek(count))
+			{
+				message = "Cannot go back that far";
+			}
+		}
+		else if (name == "c" && parseHex(command, address))
+		{
+			//a limit keeps the debugger responsive when there is no write
+			if (!history.continueToWrite(static_cast<Word>(address), 100000000))
+			{
+				message = "No write within 100000000 instructions";
+			}
+		}
+		else if (name == "r" && parseHex(command, address))
+		{
+			if (!history.reverseContinueToWrite(static_cast<Word>(address)))
+			{
+				message = "No write found in the history";
+			}
+		}
+		else if (name == "w" && parseHex(command, address))
+		{
+			History::Position writer;
+			std::ostringstream result;
+			if (history.findLastWrite(static_cast<Word>(address), writer))
+			{
+				result << "Last written by the instruction at position " << writer;
+			}
+			else
+			{
+				result << "No write found in the history";
+			}
+			message = result.str();
+		}
+		else if (name == "i" && parseHex(command, address) && parseHex(command, value))
+		{
+			history.injectInput(static_cast<Word>(address), static_cast<Word>(value));
+		}
+		else if (name == "q")
+		{
+			return;
+		}
+		else
+		{
+			message = "Unknown command";
+		}
+	}
+}
+
 int main(int argc, char **argv)
 {
 	const vector<string> args(argv + 1, argv + argc);
@@ -71,6 +316,78 @@ int main(int argc, char **argv)
 			case 'h':
 				options.consoleHeight = stoi(arg.c_str() + 2);
 				break;
+
+			case 'l':
+				options.accelerateLoops = (stoi(arg.c_str() + 2) != 0);
+				break;
+
+			case 't':
+				options.historyInterval = stoi(arg.c_str() + 2);
+				break;
+				
+			case 'f':
+				options.machineFileName = arg.substr(2);
+				break;
+				
+			case 'o':
+				options.logFileName = arg.substr(2);
+				break;
+				
+			case 'b':
+				options.blockFileName = arg.substr(2);
+				break;
+				
+			case 'd':
+				options.dma = true;
+				break;
+				
+			case 'P':
+				options.performanceMonitor = true;
+				break;
+				
+			case 'g':
+				options.profileFileName = arg.substr(2);
+				break;
+				
+			case 'G':
+				options.sampleRate = stoi(arg.c_str() + 2);
+				break;
+				
+			case 'C':
+				options.callGraphFileName = arg.substr(2);
+				break;
+				
+			case 'a':
+				options.heatmapReportFileName = arg.substr(2);
+				break;
+				
+			case 'A':
+				options.heatmapImageFileName = arg.substr(2);
+				break;
+				
+			case 'W':
+				options.workingSetInterval = stoull(arg.c_str() + 2);
+				break;
+				
+			case 'x':
+				options.coverageFileName = arg.substr(2);
+				break;
+				
+			case 'X':
+				options.listingCoverageFileName = arg.substr(2);
+				break;
+				
+			case 'F':
+				options.framePrefix = arg.substr(2);
+				break;
+				
+			case 'R':
+				options.rawFrameFileName = arg.substr(2);
+				break;
+				
+			case 'k':
+				options.inputScriptFileName = arg.substr(2);
+				break;
 			
 			default:
 				cerr << "Invalid option '" << arg << "'";
@@ -101,20 +418,69 @@ int main(int argc, char **argv)
 	}
 	
 	Machine machine(std::move(program));
+	machine.accelerateLoops = options.accelerateLoops;
+	
+	MachineFile machineFile;
+	if (!options.machineFileName.empty())
+	{
+		bool resumed;
+		if (!machineFile.open(options.machineFileName, machine, resumed))
+		{
+			cerr << "Could not open machine file '" << options.machineFileName << "'" << endl;
+			return 1;
+		}
+		
+		if (resumed)
+		{
+			cerr << "Resuming from '" << options.machineFileName << "'" << endl;
+		}
+	}
+	
+	//stop between two instructions so that the file stays consistent and the
+	//profiles are written
+	if (!options.machineFileName.empty() ||
+		!options.profileFileName.empty() ||
+		!options.callGraphFileName.empty() ||
+		!options.heatmapReportFileName.empty() ||
+		!options.heatmapImageFileName.empty() ||
+		!options.coverageFileName.empty() ||
+		!options.listingCoverageFileName.empty() ||
+		!options.framePrefix.empty() ||
+		!options.rawFrameFileName.empty())
+	{
+		std::signal(SIGINT, requestStop);
+		std::signal(SIGTERM, requestStop);
+	}
 	
 	struct DebuggingContext
 	{
 		Machine &machine;
 		const Options &options;
+		MachineFile &machineFile;
 		unsigned intervalCounter;
+		Profile profile;
+		const bool tracksCoverage;
+		Coverage coverage;
+		
+		//null if the output goes to the terminal
+		FrameCapture *frames;
+		
+		//null if there is no input script
+		ScriptedKeyboard *keyboard;
+		InterruptController *interrupts;
 #ifdef WIN32
 		HANDLE console;
 #endif
 		
-		explicit DebuggingContext(Machine &machine, const Options &options)
+		explicit DebuggingContext(Machine &machine, const Options &options, MachineFile &machineFile)
 			: machine(machine)
 			, options(options)
+			, machineFile(machineFile)
 			, intervalCounter(0)
+			, tracksCoverage(!options.coverageFileName.empty() || !options.listingCoverageFileName.empty())
+			, frames(0)
+			, keyboard(0)
+			, interrupts(0)
 #ifdef WIN32
 			, console(GetStdHandle(STD_OUTPUT_HANDLE))
 #endif
@@ -196,12 +562,75 @@ int main(int argc, char **argv)
 			fflush(stdout);
 		}
 		
+		void showScreen()
+		{
+			if (frames)
+			{
+				frames->capture(machine);
+			}
+			else
+			{
+				printInfo();
+			}
+		}
+		
 		bool startInstruction()
 		{
+			if (sampleRequested)
+			{
+				sampleRequested = 0;
+				profile.sample(machine);
+			}
+			
+			if (options.dma)
+			{
+				runDma(machine);
+			}
+			
+			if (keyboard)
+			{
+				//the time of a waiting machine passes until the script types
+				//the next keys
+				std::uint64_t wakeUp;
+				if (isWaiting(machine) &&
+					keyboard->getWakeUpCycles(wakeUp))
+				{
+					machine.cycles = std::max(machine.cycles, wakeUp);
+				}
+				
+				if (keyboard->isStopDue(machine))
+				{
+					showScreen();
+					machineFile.saveRegisters(machine);
+					return false;
+				}
+				
+				if (keyboard->feed(machine))
+				{
+					interrupts->raise(InterruptLine_Keyboard);
+				}
+				interrupts->deliver(machine);
+			}
+			
+			//nothing else raises interrupt lines here, so the machine would wait
+			//forever
+			if (isWaiting(machine))
+			{
+				showScreen();
+				machineFile.saveRegisters(machine);
+				
+				//a script cannot be interrupted by a human
+				if (!keyboard)
+				{
+					waitForStop();
+				}
+				return false;
+			}
+			
 			++intervalCounter;
 			if (intervalCounter == options.updateInterval)
 			{
-				printInfo();
+				showScreen();
 				intervalCounter = 0;
 			}
 
@@ -213,11 +642,341 @@ int main(int argc, char **argv)
 				usleep(options.sleepMs * 1000);
 #endif
 			}
+			
+			machineFile.saveRegisters(machine);
+			if (stopRequested)
+			{
+				return false;
+			}
+			
+			//a bit per instruction is cheap enough to leave loops accelerated
+			if (tracksCoverage &&
+				!machine.skipNext)
+			{
+				coverage.set(machine.pc);
+			}
 			return true;
 		}
+		
+		//an accelerated loop must not run past the next keys of the script
+		std::uint64_t getCycleLimit() const
+		{
+			std::uint64_t limit;
+			if (keyboard &&
+				keyboard->getWakeUpCycles(limit))
+			{
+				return limit;
+			}
+			return std::numeric_limits<std::uint64_t>::max();
+		}
 	};
 	
-	DebuggingContext context(machine, options);
-	machine.run(context);
+	DebuggingContext context(machine, options, machineFile);
+	
+	//The analyses which are not null see every instruction, so loops are
+	//not accelerated.
+	struct AnalysisContext
+	{
+		DebuggingContext &context;
+		const Machine &machine;
+		CallGraph *graph;
+		MemoryHeatmap *heatmap;
+		
+		bool startInstruction()
+		{
+			if (!context.startInstruction())
+			{
+				return false;
+			}
+			
+			if (heatmap)
+			{
+				heatmap->onInstruction(machine);
+			}
+			return true;
+		}
+		
+		void onMemoryRead(Word address)
+		{
+			if (heatmap)
+			{
+				heatmap->onMemoryRead(address);
+			}
+		}
+		
+		void onMemoryWrite(Word address, Word)
+		{
+			if (heatmap)
+			{
+				heatmap->onMemoryWrite(address);
+			}
+		}
+		
+		void onJsr(Word, Word to)
+		{
+			if (graph)
+			{
+				graph->onJsr(machine, to);
+			}
+		}
+		
+		void onBranch(Word from, Word to)
+		{
+			if (graph)
+			{
+				graph->onBranch(machine, from, to);
+			}
+		}
+		
+		void onCycle(unsigned cycles)
+		{
+			if (graph)
+			{
+				graph->onCycle(cycles);
+			}
+			
+			if (heatmap)
+			{
+				heatmap->onCycle(cycles);
+			}
+		}
+	};
+	
+	if (options.historyInterval)
+	{
+		//the history replays instructions, so there are no hypercalls and
+		//no host time
+		runDebugger(machine, options, [&context]() { context.printInfo(); });
+	}
+	else
+	{
+		//the screen is on stdout, so the log goes to stderr by default
+		std::shared_ptr<std::ostream> log(&std::cerr, [](std::ostream *) {});
+		if (!options.logFileName.empty())
+		{
+			log = std::make_shared<std::ofstream>(options.logFileName.c_str(), std::ios::binary | std::ios::app);
+			if (!*log)
+			{
+				cerr << "Could not open log file '" << options.logFileName << "'" << endl;
+				return 1;
+			}
+		}
+		
+		std::shared_ptr<std::istream> blocks;
+		if (!options.blockFileName.empty())
+		{
+			blocks = std::make_shared<std::ifstream>(options.blockFileName.c_str(), std::ios::binary);
+			if (!*blocks)
+			{
+				cerr << "Could not open block file '" << options.blockFileName << "'" << endl;
+				return 1;
+			}
+		}
+		
+#ifndef WIN32
+		//the timer counts the CPU time of the emulator, so the sleeps
+		//between the instructions are not sampled
+		if (!options.profileFileName.empty() &&
+			options.sampleRate)
+		{
+			const long interval = std::max(1000000L / static_cast<long>(options.sampleRate), 1L);
+			std::signal(SIGPROF, requestSample);
+			
+			itimerval timer = {};
+			timer.it_interval.tv_sec = interval / 1000000;
+			timer.it_interval.tv_usec = interval % 1000000;
+			timer.it_value = timer.it_interval;
+			setitimer(ITIMER_PROF, &timer, 0);
+		}
+#endif
+		
+		const Hypercalls hypercalls = createHostHypercalls(log, blocks);
+		machine.hypercalls = &hypercalls;
+		machine.performanceMonitor = options.performanceMonitor;
+		//headless if the frames are captured
+		std::unique_ptr<FrameCapture> frames;
+		std::unique_ptr<std::ofstream> rawFrameFile;
+		if (!options.framePrefix.empty() ||
+			!options.rawFrameFileName.empty())
+		{
+			std::ostream *raw = 0;
+			if (options.rawFrameFileName == "-")
+			{
+				raw = &std::cout;
+			}
+			else if (!options.rawFrameFileName.empty())
+			{
+				rawFrameFile.reset(new std::ofstream(options.rawFrameFileName.c_str(), std::ios::binary));
+				if (!*rawFrameFile)
+				{
+					cerr << "Could not open raw frame file '" << options.rawFrameFileName << "'" << endl;
+					return 1;
+				}
+				raw = rawFrameFile.get();
+			}
+			
+			frames.reset(new FrameCapture(options, raw));
+			context.frames = frames.get();
+		}
+		
+		std::unique_ptr<ScriptedKeyboard> keyboard;
+		InterruptController interrupts;
+		if (!options.inputScriptFileName.empty())
+		{
+			std::ifstream scriptFile(options.inputScriptFileName.c_str());
+			if (!scriptFile)
+			{
+				cerr << "Could not open input script '" << options.inputScriptFileName << "'" << endl;
+				return 1;
+			}
+			
+			InputScript script;
+			unsigned errorLine;
+			if (!script.load(scriptFile, errorLine))
+			{
+				cerr << "Invalid input script '" << options.inputScriptFileName << "' in line " << errorLine << endl;
+				return 1;
+			}
+			
+			keyboard.reset(new ScriptedKeyboard(std::move(script)));
+			context.keyboard = keyboard.get();
+			context.interrupts = &interrupts;
+		}
+		
+		std::unique_ptr<CallGraph> graph;
+		if (!options.callGraphFileName.empty())
+		{
+			graph.reset(new CallGraph(machine.pc));
+		}
+		
+		std::unique_ptr<MemoryHeatmap> heatmap;
+		if (!options.heatmapReportFileName.empty() ||
+			!options.heatmapImageFileName.empty())
+		{
+			heatmap.reset(new MemoryHeatmap(options.workingSetInterval));
+			
+			//DMA, blocks read by hypercalls and keys are not written by
+			//instructions
+			machine.writeObserver = heatmap.get();
+		}
+		
+		if (graph ||
+			heatmap)
+		{
+			AnalysisContext analysisContext = {context, machine, graph.get(), heatmap.get()};
+			machine.run(analysisContext);
+		}
+		else
+		{
+			machine.run(context);
+		}
+		
+		if (graph)
+		{
+			graph->finish();
+			
+			std::ofstream callGraphFile(options.callGraphFileName.c_str());
+			writeCallgrind(callGraphFile, *graph, loadSymbols(programFileName));
+			if (!callGraphFile)
+			{
+				cerr << "Could not write call graph '" << options.callGraphFileName << "'" << endl;
+			}
+		}
+		
+		if (!options.coverageFileName.empty())
+		{
+			//the runs of a test suite add up
+			bool merged = true;
+			{
+				std::ifstream previous(options.coverageFileName.c_str(), std::ios::binary);
+				if (previous)
+				{
+					merged = mergeCoverage(previous, context.coverage);
+				}
+			}
+			
+			//the file may be something else which was given by mistake
+			if (!merged)
+			{
+				cerr << "Could not read coverage '" << options.coverageFileName << "', it is left unchanged" << endl;
+			}
+			else
+			{
+				std::ofstream coverageFile(options.coverageFileName.c_str(), std::ios::binary);
+				writeCoverage(coverageFile, context.coverage);
+				if (!coverageFile)
+				{
+					cerr << "Could not write coverage '" << options.coverageFileName << "'" << endl;
+				}
+			}
+		}
+		
+		if (!options.listingCoverageFileName.empty())
+		{
+			const auto symbols = loadSymbols(programFileName);
+			if (symbols.lines.empty())
+			{
+				cerr << "There is no listing '" << getListingFileName(programFileName) << "'" << endl;
+			}
+			else
+			{
+				std::ofstream listingFile(options.listingCoverageFileName.c_str());
+				const auto summary = writeListingCoverage(listingFile, context.coverage, symbols);
+				if (!listingFile)
+				{
+					cerr << "Could not write listing coverage '" << options.listingCoverageFileName << "'" << endl;
+				}
+				cerr << summary.executedLines << " of " << summary.instructionLines << " instructions executed" << endl;
+			}
+		}
+		
+		if (!options.heatmapReportFileName.empty())
+		{
+			std::ofstream reportFile(options.heatmapReportFileName.c_str());
+			writeHeatmapReport(reportFile, *heatmap);
+			if (!reportFile)
+			{
+				cerr << "Could not write heatmap report '" << options.heatmapReportFileName << "'" << endl;
+			}
+		}
+		
+		if (!options.heatmapImageFileName.empty())
+		{
+			std::ofstream imageFile(options.heatmapImageFileName.c_str(), std::ios::binary);
+			writeHeatmapImage(imageFile, *heatmap);
+			if (!imageFile)
+			{
+				cerr << "Could not write heatmap image '" << options.heatmapImageFileName << "'" << endl;
+			}
+		}
+		machine.hypercalls = 0;
+		machine.writeObserver = 0;
+		machine.performanceMonitor = false;
+		
+		if (frames)
+		{
+			//the last changes since the previous frame
+			frames->capture(machine);
+			context.frames = 0;
+			
+			if (!options.rawFrameFileName.empty() &&
+				!(rawFrameFile ? *rawFrameFile : std::cout).flush())
+			{
+				cerr << "Could not write raw frames '" << options.rawFrameFileName << "'" << endl;
+			}
+		}
+		
+		if (!options.profileFileName.empty())
+		{
+			std::ofstream profileFile(options.profileFileName.c_str());
+			writeFoldedStacks(profileFile, context.profile, loadSymbols(programFileName), "");
+			if (!profileFile)
+			{
+				cerr << "Could not write profile '" << options.profileFileName << "'" << endl;
+			}
+		}
+	}
+	
+	machineFile.sync(machine);
 }
 
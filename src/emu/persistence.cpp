@@ -0,0 +1,191 @@
+#include "persistence.hpp"
+#include <algorithm>
+#include <cstring>
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		const char MachineFileMagic[8] = {'D', 'C', 'P', 'U', 'M', 'E', 'M', '1'};
+		const std::uint32_t MachineFileVersion = 2;
+		
+		const std::size_t MemorySizeInBytes = MemorySizeInWords * sizeof(Word);
+	}
+	
+	
+	MachineFile::MachineFile()
+		: m_file(-1)
+		, m_header(0)
+		, m_pageSize(0)
+	{
+	}
+	
+#ifdef WIN32
+	MachineFile::~MachineFile()
+	{
+	}
+	
+	bool MachineFile::open(const std::string &, Machine &, bool &)
+	{
+		return false;
+	}
+	
+	void MachineFile::saveRegisters(const Machine &)
+	{
+	}
+	
+	void MachineFile::sync(const Machine &)
+	{
+	}
+#else
+	MachineFile::~MachineFile()
+	{
+		//the mapping of the memory belongs to the machine
+		if (m_header)
+		{
+			::munmap(m_header, m_pageSize);
+		}
+		
+		if (m_file >= 0)
+		{
+			::close(m_file);
+		}
+	}
+	
+	bool MachineFile::open(const std::string &fileName, Machine &machine, bool &resumed)
+	{
+		if (m_file >= 0)
+		{
+			return false;
+		}
+		
+		m_pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+		if (m_pageSize < sizeof(MachineFileHeader) ||
+			machine.memory.size() != MemorySizeInWords ||
+			reinterpret_cast<std::uintptr_t>(machine.memory.data()) % m_pageSize != 0)
+		{
+			return false;
+		}
+		
+		const int file = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (file < 0)
+		{
+			return false;
+		}
+		
+		struct stat status;
+		if (::fstat(file, &status) < 0)
+		{
+			::close(file);
+			return false;
+		}
+		
+		const off_t fileSize = static_cast<off_t>(m_pageSize + MemorySizeInBytes);
+		resumed = (status.st_size != 0);
+		if (resumed)
+		{
+			if (status.st_size != fileSize)
+			{
+				::close(file);
+				return false;
+			}
+		}
+		else
+		{
+			//the current memory becomes the content of the file
+			if (::ftruncate(file, fileSize) < 0 ||
+				::pwrite(file, machine.memory.data(), MemorySizeInBytes, m_pageSize) !=
+					static_cast<ssize_t>(MemorySizeInBytes))
+			{
+				::close(file);
+				return false;
+			}
+		}
+		
+		void * const header = ::mmap(0, m_pageSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if (header == MAP_FAILED)
+		{
+			::close(file);
+			return false;
+		}
+		m_header = static_cast<MachineFileHeader *>(header);
+		
+		if (resumed &&
+			(std::memcmp(m_header->magic, MachineFileMagic, sizeof(MachineFileMagic)) != 0 ||
+			m_header->version != MachineFileVersion ||
+			m_header->pageSize != m_pageSize))
+		{
+			::munmap(header, m_pageSize);
+			m_header = 0;
+			::close(file);
+			return false;
+		}
+		
+		//replaces the pages of the vector, which frees the mapping later
+		if (::mmap(machine.memory.data(), MemorySizeInBytes, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, file, static_cast<off_t>(m_pageSize)) == MAP_FAILED)
+		{
+			::munmap(header, m_pageSize);
+			m_header = 0;
+			::close(file);
+			return false;
+		}
+		
+		m_file = file;
+		
+		if (resumed)
+		{
+			std::copy(m_header->registers, m_header->registers + UniversalRegisterCount, machine.registers.begin());
+			machine.sp = m_header->sp;
+			machine.pc = m_header->pc;
+			machine.o = m_header->o;
+			machine.skipNext = (m_header->skipNext != 0);
+			machine.cycles = m_header->cycles;
+			machine.instructions = m_header->instructions;
+		}
+		else
+		{
+			std::memcpy(m_header->magic, MachineFileMagic, sizeof(MachineFileMagic));
+			m_header->version = MachineFileVersion;
+			m_header->pageSize = static_cast<std::uint32_t>(m_pageSize);
+			saveRegisters(machine);
+		}
+		return true;
+	}
+	
+	void MachineFile::saveRegisters(const Machine &machine)
+	{
+		if (!m_header)
+		{
+			return;
+		}
+		
+		std::copy(machine.registers.begin(), machine.registers.end(), m_header->registers);
+		m_header->sp = machine.sp;
+		m_header->pc = machine.pc;
+		m_header->o = machine.o;
+		m_header->skipNext = machine.skipNext;
+		m_header->cycles = machine.cycles;
+		m_header->instructions = machine.instructions;
+	}
+	
+	void MachineFile::sync(const Machine &machine)
+	{
+		if (!m_header)
+		{
+			return;
+		}
+		
+		saveRegisters(machine);
+		::msync(const_cast<Word *>(machine.memory.data()), MemorySizeInBytes, MS_SYNC);
+		::msync(m_header, m_pageSize, MS_SYNC);
+	}
+#endif
+}
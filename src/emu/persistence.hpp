@@ -0,0 +1,58 @@
+#ifndef DCPUPP_EMU_PERSISTENCE_HPP
+#define DCPUPP_EMU_PERSISTENCE_HPP
+
+
+#include "machine.hpp"
+#include <cstdint>
+#include <string>
+
+
+namespace dcpupp
+{
+	//The first page of a machine file. The memory follows in the next page.
+	struct MachineFileHeader
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t pageSize;
+		std::uint64_t cycles;
+		std::uint64_t instructions;
+		Word registers[UniversalRegisterCount];
+		Word sp, pc, o;
+		Word skipNext;
+	};
+	
+	//Keeps the state of a machine in a file which is mapped with MAP_SHARED.
+	//The memory of the machine is the file itself, so it is never saved or
+	//loaded. The registers are copied to the header page with saveRegisters.
+	//Other processes can watch a running machine by mapping the same file.
+	//
+	//Only on Unix. The memory of the machine has to be allocated by a
+	//MergeableAllocator so that it starts at a page boundary.
+	struct MachineFile
+	{
+		MachineFile();
+		~MachineFile();
+		
+		//Continues the machine from the file if it exists. Otherwise the file
+		//is created with the current state of the machine.
+		bool open(const std::string &fileName, Machine &machine, bool &resumed);
+		
+		void saveRegisters(const Machine &machine);
+		
+		//Makes sure that everything is on the disk.
+		void sync(const Machine &machine);
+		
+	private:
+	
+		int m_file;
+		MachineFileHeader *m_header;
+		std::size_t m_pageSize;
+		
+		MachineFile(const MachineFile &);
+		MachineFile &operator = (const MachineFile &);
+	};
+}
+
+
+#endif
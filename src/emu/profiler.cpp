@@ -0,0 +1,96 @@
+#include "profiler.hpp"
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		bool isJsr(Word instruction)
+		{
+			return (instruction & 0x3ff) == (NBOp_Jsr << 4);
+		}
+		
+		bool isReturnAddress(const Machine::Memory &memory, Word address)
+		{
+			//JSR is one word long or two with a next word argument
+			for (Word length = 1; length <= 2; ++length)
+			{
+				const Word jsr = memory[static_cast<Word>(address - length)];
+				if (isJsr(jsr) &&
+					getInstructionLength(jsr) == length)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+	}
+	
+	
+	Profile::Profile()
+		: samples(0)
+	{
+	}
+	
+	void Profile::sample(const Machine &machine, std::uint64_t weight)
+	{
+		Stack stack;
+		stack.push_back(machine.pc);
+		
+		//the stack grows downwards from the end of the memory, SP 0 is empty
+		unsigned address = machine.sp ? static_cast<unsigned>(machine.sp) : static_cast<unsigned>(MemorySizeInWords);
+		const unsigned end = std::min<unsigned>(address + MaxSampledStackWords, MemorySizeInWords);
+		for (; address < end && stack.size() <= MaxSampledCallDepth; ++address)
+		{
+			const Word value = machine.memory[address];
+			if (isReturnAddress(machine.memory, value))
+			{
+				stack.push_back(value);
+			}
+		}
+		
+		stacks[stack] += weight;
+		samples += weight;
+	}
+	
+	void Profile::merge(const Profile &other)
+	{
+		for (auto s = other.stacks.begin(); s != other.stacks.end(); ++s)
+		{
+			stacks[s->first] += s->second;
+		}
+		samples += other.samples;
+	}
+	
+	void writeFoldedStacks(
+		std::ostream &out,
+		const Profile &profile,
+		const SymbolTable &symbols,
+		const std::string &prefix
+		)
+	{
+		//stacks which differ only in addresses within the same label are
+		//combined
+		std::map<std::string, std::uint64_t> folded;
+		for (auto s = profile.stacks.begin(); s != profile.stacks.end(); ++s)
+		{
+			const auto &stack = s->first;
+			std::string line = prefix;
+			for (auto a = stack.rbegin(); a != stack.rend(); ++a)
+			{
+				const bool isPc = (a + 1 == stack.rend());
+				if (!line.empty())
+				{
+					line += ';';
+				}
+				line += symbols.getName(isPc ? *a : static_cast<Word>(*a - 1));
+			}
+			folded[line] += s->second;
+		}
+		
+		for (auto f = folded.begin(); f != folded.end(); ++f)
+		{
+			out << f->first << ' ' << f->second << '\n';
+		}
+	}
+}
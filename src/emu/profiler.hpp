@@ -0,0 +1,56 @@
+#ifndef DCPUPP_EMU_PROFILER_HPP
+#define DCPUPP_EMU_PROFILER_HPP
+
+
+#include "machine.hpp"
+#include "symbols.hpp"
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+namespace dcpupp
+{
+	enum
+	{
+		//return addresses taken per sample
+		MaxSampledCallDepth = 16,
+		
+		//words below the top of the stack which are searched for them
+		MaxSampledStackWords = 64,
+	};
+	
+	//Samples of PC and the return addresses on the stack. The program does
+	//not mark its frames, so every word on the stack which follows a JSR in
+	//memory is taken for a return address.
+	struct Profile
+	{
+		//PC followed by the return addresses, the innermost call first
+		typedef std::vector<Word> Stack;
+		
+		std::map<Stack, std::uint64_t> stacks;
+		std::uint64_t samples;
+		
+		Profile();
+		
+		//weight is the number of sampling intervals the sample stands for
+		void sample(const Machine &machine, std::uint64_t weight = 1);
+		void merge(const Profile &other);
+	};
+	
+	//One line per stack in the folded format of flame graph tools: prefix,
+	//the names of the calls from the outermost one to PC separated by ';'
+	//and the number of samples. A return address is named after the JSR in
+	//front of it.
+	void writeFoldedStacks(
+		std::ostream &out,
+		const Profile &profile,
+		const SymbolTable &symbols,
+		const std::string &prefix
+		);
+}
+
+
+#endif
@@ -0,0 +1,159 @@
+#include "script.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <limits>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		bool isSeparator(char c)
+		{
+			return std::isspace(static_cast<unsigned char>(c)) || (c == ';');
+		}
+		
+		//the position of the next token, the end of the line at a comment
+		std::size_t skipSpace(const std::string &line, std::size_t position)
+		{
+			while (position < line.size() &&
+				std::isspace(static_cast<unsigned char>(line[position])))
+			{
+				++position;
+			}
+			return (position < line.size() && line[position] == ';') ? line.size() : position;
+		}
+		
+		bool parseNumber(const std::string &token, int base, unsigned long long &value)
+		{
+			if (token.empty() ||
+				!std::isdigit(static_cast<unsigned char>(token[0])))
+			{
+				return false;
+			}
+			char *end;
+			value = std::strtoull(token.c_str(), &end, base);
+			return (*end == '\0');
+		}
+	}
+	
+	
+	InputScript::InputScript()
+		: stopCycles(std::numeric_limits<std::uint64_t>::max())
+	{
+	}
+	
+	bool InputScript::load(std::istream &script, unsigned &errorLine)
+	{
+		std::uint64_t cycles = 0;
+		std::string line;
+		for (errorLine = 1; std::getline(script, line); ++errorLine)
+		{
+			std::size_t position = skipSpace(line, 0);
+			if (position == line.size())
+			{
+				continue;
+			}
+			
+			const bool relative = (line[position] == '+');
+			if (relative)
+			{
+				++position;
+			}
+			const auto end = std::find_if(line.begin() + position, line.end(), isSeparator) - line.begin();
+			unsigned long long count;
+			if (!parseNumber(line.substr(position, end - position), 10, count) ||
+				(!relative && count < cycles))
+			{
+				return false;
+			}
+			cycles = relative ? (cycles + count) : count;
+			
+			Event event;
+			event.cycles = cycles;
+			
+			for (position = skipSpace(line, end); position < line.size(); position = skipSpace(line, position))
+			{
+				if (line[position] == '"')
+				{
+					const auto close = line.find('"', position + 1);
+					if (close == std::string::npos ||
+						close == position + 1)
+					{
+						return false;
+					}
+					for (auto c = position + 1; c < close; ++c)
+					{
+						event.keys.push_back(static_cast<unsigned char>(line[c]));
+					}
+					position = close + 1;
+					continue;
+				}
+				
+				const auto tokenEnd = std::find_if(line.begin() + position, line.end(), isSeparator) - line.begin();
+				const auto token = line.substr(position, tokenEnd - position);
+				position = tokenEnd;
+				
+				if (token == "stop")
+				{
+					stopCycles = std::min(stopCycles, cycles);
+					continue;
+				}
+				
+				//0 would mean that there is no key
+				unsigned long long key;
+				if (!parseNumber(token, 0, key) ||
+					key == 0 ||
+					key > 0xffff)
+				{
+					return false;
+				}
+				event.keys.push_back(static_cast<Word>(key));
+			}
+			
+			if (!event.keys.empty())
+			{
+				events.push_back(std::move(event));
+			}
+		}
+		
+		errorLine = 0;
+		return true;
+	}
+	
+	
+	ScriptedKeyboard::ScriptedKeyboard(InputScript script)
+		: m_script(std::move(script))
+		, m_next(0)
+	{
+	}
+	
+	bool ScriptedKeyboard::feed(Machine &machine)
+	{
+		while (m_next < m_script.events.size() &&
+			m_script.events[m_next].cycles <= machine.cycles)
+		{
+			const auto &keys = m_script.events[m_next].keys;
+			m_keyboard.keys.insert(m_keyboard.keys.end(), keys.begin(), keys.end());
+			++m_next;
+		}
+		
+		return m_keyboard.deliver(machine);
+	}
+	
+	bool ScriptedKeyboard::isStopDue(const Machine &machine) const
+	{
+		return (machine.cycles >= m_script.stopCycles);
+	}
+	
+	bool ScriptedKeyboard::getWakeUpCycles(std::uint64_t &cycles) const
+	{
+		cycles = m_script.stopCycles;
+		if (m_next < m_script.events.size())
+		{
+			cycles = std::min(cycles, m_script.events[m_next].cycles);
+		}
+		return (cycles != std::numeric_limits<std::uint64_t>::max());
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef DCPUPP_EMU_SCRIPT_HPP
+#define DCPUPP_EMU_SCRIPT_HPP
+
+
+#include "keyboard.hpp"
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+
+namespace dcpupp
+{
+	//Keys which are typed at a cycle count. The run of an interactive program
+	//depends only on the script then, so it can be repeated without a human
+	//at the keyboard and without any sleeps.
+	//
+	//Every line of a script is a cycle count followed by the keys to type at
+	//that count. "+n" counts n cycles from the previous line. A key is a number
+	//(0x for hex) or the characters of a string in double quotes. "stop" ends
+	//the run at that count. Everything after a ';' is a comment.
+	//
+	//	; the name, then enter
+	//	2000000 "Conan" 10
+	//	+500000 "wwd"
+	//	+5000000 stop
+	struct InputScript
+	{
+		struct Event
+		{
+			std::uint64_t cycles;
+			std::vector<Word> keys;
+		};
+		
+		//ordered by the cycle count
+		std::vector<Event> events;
+		std::uint64_t stopCycles;
+		
+		InputScript();
+		
+		//Returns false and the number of the bad line if the script is malformed.
+		bool load(std::istream &script, unsigned &errorLine);
+	};
+	
+	//Types the keys of an InputScript on a KeyboardQueue.
+	struct ScriptedKeyboard
+	{
+		explicit ScriptedKeyboard(InputScript script);
+		
+		//Queues the keys which are due at the cycle count of the machine and
+		//writes the next key if the program is ready for it.
+		//Returns true if a key was written.
+		bool feed(Machine &machine);
+		
+		bool isStopDue(const Machine &machine) const;
+		
+		//The cycle count of the next line or the stop, which a waiting machine
+		//can skip to. Returns false if there is neither.
+		bool getWakeUpCycles(std::uint64_t &cycles) const;
+	
+	private:
+	
+		const InputScript m_script;
+		std::size_t m_next;
+		KeyboardQueue m_keyboard;
+	};
+}
+
+
+#endif
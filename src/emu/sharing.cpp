@@ -0,0 +1,107 @@
+#include "sharing.hpp"
+#include "hash.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		std::size_t getPageSize()
+		{
+#ifdef WIN32
+			return 4096;
+#else
+			return static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+		}
+		
+		std::size_t readCounter(const std::string &fileName)
+		{
+			std::ifstream file(fileName.c_str());
+			std::size_t value = 0;
+			file >> value;
+			return value;
+		}
+		
+		bool isZero(const Word *page, std::size_t size)
+		{
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				if (page[i])
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+	
+	
+	PageSharingStatistics measurePageSharing(
+		const std::vector<const Machine::Memory *> &memories
+		)
+	{
+		PageSharingStatistics statistics;
+		statistics.pageSizeInBytes = getPageSize();
+		statistics.pages = 0;
+		statistics.distinctPages = 0;
+		statistics.zeroPages = 0;
+		statistics.systemSharedPages = 0;
+		statistics.systemSharingPages = 0;
+		
+		//only since Linux 6.1
+		statistics.kernelMergingPages = readCounter("/proc/self/ksm_merging_pages");
+		if (!statistics.kernelMergingPages)
+		{
+			statistics.systemSharedPages = readCounter("/sys/kernel/mm/ksm/pages_shared");
+			statistics.systemSharingPages = readCounter("/sys/kernel/mm/ksm/pages_sharing");
+		}
+		
+		const std::size_t pageSize = statistics.pageSizeInBytes / sizeof(Word);
+		std::unordered_multimap<std::uint64_t, const Word *> distinct;
+		
+		for (auto m = memories.begin(); m != memories.end(); ++m)
+		{
+			const Machine::Memory &memory = **m;
+			for (std::size_t offset = 0; offset + pageSize <= memory.size(); offset += pageSize)
+			{
+				const Word * const page = memory.data() + offset;
+				const auto hash = hashWords(HashBasis, page, pageSize);
+				
+				++statistics.pages;
+				
+				if (isZero(page, pageSize))
+				{
+					++statistics.zeroPages;
+				}
+				
+				bool isNew = true;
+				const auto equalHashes = distinct.equal_range(hash);
+				for (auto d = equalHashes.first; d != equalHashes.second; ++d)
+				{
+					if (std::memcmp(d->second, page, pageSize * sizeof(Word)) == 0)
+					{
+						isNew = false;
+						break;
+					}
+				}
+				
+				if (isNew)
+				{
+					distinct.insert(std::make_pair(hash, page));
+					++statistics.distinctPages;
+				}
+			}
+		}
+		
+		return statistics;
+	}
+}
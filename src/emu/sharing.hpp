@@ -0,0 +1,40 @@
+#ifndef DCPUPP_EMU_SHARING_HPP
+#define DCPUPP_EMU_SHARING_HPP
+
+
+#include "machine.hpp"
+#include <cstddef>
+#include <vector>
+
+
+namespace dcpupp
+{
+	struct PageSharingStatistics
+	{
+		std::size_t pageSizeInBytes;
+		std::size_t pages;
+		
+		//pages left if all equal pages were merged
+		std::size_t distinctPages;
+		
+		//Pages which contain only zeros. Machines which get no input have many
+		//of them, so they make up much of what could be merged.
+		std::size_t zeroPages;
+		
+		//pages of this process which the kernel actually merged, 0 if unknown
+		std::size_t kernelMergingPages;
+		
+		//The pages merged by the kernel in all processes of the system, only
+		//if the number for this process is unknown.
+		std::size_t systemSharedPages;
+		std::size_t systemSharingPages;
+	};
+	
+	//Counts the host pages of the memories which have equal content.
+	PageSharingStatistics measurePageSharing(
+		const std::vector<const Machine::Memory *> &memories
+		);
+}
+
+
+#endif
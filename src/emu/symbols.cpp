@@ -0,0 +1,99 @@
+#include "symbols.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		std::string formatAddress(Word address)
+		{
+			std::ostringstream name;
+			name << "0x" << std::hex << std::setw(4) << std::setfill('0') << address;
+			return name.str();
+		}
+	}
+	
+	
+	bool SymbolTable::load(std::istream &listing)
+	{
+		unsigned address = 0;
+		std::string line;
+		while (std::getline(listing, line))
+		{
+			//the size is at the end in parentheses
+			const auto open = line.rfind(" (");
+			if (open == std::string::npos ||
+				line.empty() ||
+				line[line.size() - 1] != ')')
+			{
+				return false;
+			}
+			const unsigned size = std::strtoul(line.c_str() + open + 2, 0, 10);
+			
+			Line listed;
+			listed.address = static_cast<Word>(address);
+			listed.size = static_cast<Word>(size);
+			
+			std::size_t statement = 0;
+			if (line[0] == ':')
+			{
+				const auto end = line.find(' ');
+				listed.label = line.substr(1, end - 1);
+				labels[listed.address] = listed.label;
+				statement = std::min(end + 1, open);
+			}
+			
+			listed.statement = line.substr(statement, open - statement);
+			lines.push_back(listed);
+			
+			address += size;
+		}
+		
+		return true;
+	}
+	
+	std::string SymbolTable::getName(Word address) const
+	{
+		auto label = labels.upper_bound(address);
+		if (label != labels.begin())
+		{
+			return (--label)->second;
+		}
+		return formatAddress(address);
+	}
+	
+	std::string SymbolTable::getExactName(Word address) const
+	{
+		const auto label = labels.find(address);
+		return (label == labels.end()) ? formatAddress(address) : label->second;
+	}
+	
+	std::string getListingFileName(const std::string &imageFileName)
+	{
+		const std::string binary = ".bin";
+		if (imageFileName.size() > binary.size() &&
+			imageFileName.compare(imageFileName.size() - binary.size(), binary.size(), binary) == 0)
+		{
+			return imageFileName.substr(0, imageFileName.size() - binary.size()) + ".fb";
+		}
+		return imageFileName + ".fb";
+	}
+	
+	SymbolTable loadSymbols(const std::string &imageFileName)
+	{
+		SymbolTable symbols;
+		std::ifstream listing(getListingFileName(imageFileName).c_str());
+		if (listing &&
+			!symbols.load(listing))
+		{
+			symbols.labels.clear();
+			symbols.lines.clear();
+		}
+		return symbols;
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef DCPUPP_EMU_SYMBOLS_HPP
+#define DCPUPP_EMU_SYMBOLS_HPP
+
+
+#include "common/types.hpp"
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace dcpupp
+{
+	//The labels and lines of a program as listed by dcpuasm in the feedback
+	//file (<source>.fb). Every line of the listing ends with the size of the line
+	//in memory, so the addresses follow from the sizes when the program
+	//starts at address 0.
+	struct SymbolTable
+	{
+		struct Line
+		{
+			Word address;
+			Word size;
+			std::string label;
+			
+			//as printed by the assembler
+			std::string statement;
+		};
+		
+		std::map<Word, std::string> labels;
+		std::vector<Line> lines;
+		
+		//returns false if the listing is malformed
+		bool load(std::istream &listing);
+		
+		//the label at or before address, the address in hex if there is none
+		std::string getName(Word address) const;
+		
+		//the label at address, the address in hex if there is none
+		std::string getExactName(Word address) const;
+	};
+	
+	//<source>.fb for an image named <source>.bin, otherwise <image>.fb
+	std::string getListingFileName(const std::string &imageFileName);
+	
+	//An empty table if there is no listing for the image.
+	SymbolTable loadSymbols(const std::string &imageFileName);
+}
+
+
+#endif
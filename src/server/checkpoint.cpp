@@ -0,0 +1,511 @@
+#include "checkpoint.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		//Everything is in the byte order of the host:
+		//
+		//file:    FileMagic, record...
+		//record:  RecordMagic, page count (32 bit), key, cycles, instructions (64 bit),
+		//         registers, SP, PC, O, flags (16 bit each),
+		//         page ids (16 bit each), page contents,
+		//         EndMagic, page count (32 bit)
+		const char FileMagic[8] = {'D', 'C', 'P', 'U', 'C', 'K', 'P', '3'};
+
+		const std::uint32_t RecordMagic = 0x54504b43;
+		const std::uint32_t EndMagic = 0x454e4f44;
+
+		enum
+		{
+			Flag_SkipNext = 1,
+			Flag_Full = 2,
+
+			RecordHeaderSize = 4 + 4 + 8 + 8 + 8 + (UniversalRegisterCount + 4) * 2,
+			RecordTrailerSize = 4 + 4,
+		};
+
+		std::size_t getRecordSize(std::size_t pageCount)
+		{
+			return RecordHeaderSize +
+				pageCount * (1 + MemoryPageSizeInWords) * sizeof(Word) +
+				RecordTrailerSize;
+		}
+
+		template <class T>
+		void append(std::vector<char> &destination, const T &value)
+		{
+			const char * const bytes = reinterpret_cast<const char *>(&value);
+			destination.insert(destination.end(), bytes, bytes + sizeof(value));
+		}
+
+		template <class T>
+		T readAt(const char *source)
+		{
+			T value;
+			std::memcpy(&value, source, sizeof(value));
+			return value;
+		}
+
+		std::vector<char> serialize(const MachineCheckpoint &checkpoint)
+		{
+			const auto pageCount = static_cast<std::uint32_t>(checkpoint.pageIds.size());
+
+			std::vector<char> record;
+			record.reserve(getRecordSize(pageCount));
+
+			append(record, RecordMagic);
+			append(record, pageCount);
+			append(record, checkpoint.key);
+			append(record, checkpoint.cycles);
+			append(record, checkpoint.instructions);
+			for (auto r = checkpoint.registers.begin(); r != checkpoint.registers.end(); ++r)
+			{
+				append(record, *r);
+			}
+			append(record, checkpoint.sp);
+			append(record, checkpoint.pc);
+			append(record, checkpoint.o);
+			append(record, static_cast<Word>(
+				(checkpoint.skipNext ? Flag_SkipNext : 0) |
+				(checkpoint.full ? Flag_Full : 0)));
+
+			const char * const ids = reinterpret_cast<const char *>(checkpoint.pageIds.data());
+			record.insert(record.end(), ids, ids + pageCount * sizeof(Word));
+
+			const char * const contents = reinterpret_cast<const char *>(checkpoint.pageContents.data());
+			record.insert(record.end(), contents, contents + checkpoint.pageContents.size() * sizeof(Word));
+
+			append(record, EndMagic);
+			append(record, pageCount);
+
+			assert(record.size() == getRecordSize(pageCount));
+			return record;
+		}
+
+		//Applies the record at the beginning of data. Returns its size or 0
+		//if it is incomplete or invalid.
+		std::size_t applyRecord(const char *data, std::size_t size, bool needsFull, std::uint64_t key, Machine &machine)
+		{
+			if (size < RecordHeaderSize ||
+				readAt<std::uint32_t>(data) != RecordMagic)
+			{
+				return 0;
+			}
+
+			const auto pageCount = readAt<std::uint32_t>(data + 4);
+			if (pageCount > MemoryPageCount ||
+				getRecordSize(pageCount) > size)
+			{
+				return 0;
+			}
+
+			const std::size_t recordSize = getRecordSize(pageCount);
+			const char * const trailer = data + recordSize - RecordTrailerSize;
+			if (readAt<std::uint32_t>(trailer) != EndMagic ||
+				readAt<std::uint32_t>(trailer + 4) != pageCount)
+			{
+				return 0;
+			}
+
+			if (readAt<std::uint64_t>(data + 8) != key)
+			{
+				return 0;
+			}
+
+			const char *registers = data + 32;
+			const auto flags = readAt<Word>(registers + (UniversalRegisterCount + 3) * 2);
+			if (needsFull &&
+				!(flags & Flag_Full))
+			{
+				return 0;
+			}
+
+			const char * const ids = data + RecordHeaderSize;
+			for (std::uint32_t i = 0; i < pageCount; ++i)
+			{
+				if (readAt<Word>(ids + i * sizeof(Word)) >= MemoryPageCount)
+				{
+					return 0;
+				}
+			}
+
+			const char *contents = ids + pageCount * sizeof(Word);
+			for (std::uint32_t i = 0; i < pageCount; ++i)
+			{
+				const auto page = readAt<Word>(ids + i * sizeof(Word));
+				std::memcpy(
+					machine.memory.data() + page * MemoryPageSizeInWords,
+					contents,
+					MemoryPageSizeInWords * sizeof(Word));
+				contents += MemoryPageSizeInWords * sizeof(Word);
+			}
+
+			machine.cycles = readAt<std::uint64_t>(data + 16);
+			machine.instructions = readAt<std::uint64_t>(data + 24);
+			for (auto r = machine.registers.begin(); r != machine.registers.end(); ++r)
+			{
+				*r = readAt<Word>(registers);
+				registers += sizeof(Word);
+			}
+			machine.sp = readAt<Word>(registers);
+			machine.pc = readAt<Word>(registers + 2);
+			machine.o = readAt<Word>(registers + 4);
+			machine.skipNext = ((flags & Flag_SkipNext) != 0);
+			return recordSize;
+		}
+
+		bool writeAll(int file, const char *data, std::size_t size)
+		{
+			while (size > 0)
+			{
+				const auto written = ::write(file, data, size);
+				if (written < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					return false;
+				}
+				data += written;
+				size -= written;
+			}
+			return true;
+		}
+
+		bool syncDirectoryOf(const std::string &fileName)
+		{
+			const auto slash = fileName.rfind('/');
+			const std::string directory = (slash == std::string::npos) ? "." :
+				((slash == 0) ? "/" : fileName.substr(0, slash));
+
+			const int file = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+			if (file < 0)
+			{
+				return false;
+			}
+
+			const bool success = (::fsync(file) == 0);
+			::close(file);
+			return success;
+		}
+
+		MachineCheckpoint copyPages(const Machine &machine, const Machine::PageSet &pages)
+		{
+			MachineCheckpoint checkpoint;
+			checkpoint.key = 0;
+			checkpoint.cycles = machine.cycles;
+			checkpoint.instructions = machine.instructions;
+			checkpoint.registers = machine.registers;
+			checkpoint.sp = machine.sp;
+			checkpoint.pc = machine.pc;
+			checkpoint.o = machine.o;
+			checkpoint.skipNext = machine.skipNext;
+
+			const auto pageCount = pages.count();
+			checkpoint.pageIds.reserve(pageCount);
+			checkpoint.pageContents.resize(pageCount * MemoryPageSizeInWords);
+
+			Word *contents = checkpoint.pageContents.data();
+			for (std::size_t page = 0; page < MemoryPageCount; ++page)
+			{
+				if (pages.test(page))
+				{
+					checkpoint.pageIds.push_back(static_cast<Word>(page));
+					std::memcpy(
+						contents,
+						machine.memory.data() + page * MemoryPageSizeInWords,
+						MemoryPageSizeInWords * sizeof(Word));
+					contents += MemoryPageSizeInWords;
+				}
+			}
+			return checkpoint;
+		}
+	}
+
+
+	MachineCheckpoint takeCheckpoint(Machine &machine, bool full)
+	{
+		if (full)
+		{
+			machine.dirtyPages.set();
+		}
+
+		auto checkpoint = copyPages(machine, machine.dirtyPages);
+		checkpoint.full = full;
+		machine.dirtyPages.reset();
+		return checkpoint;
+	}
+
+	MachineCheckpoint copyMachine(const Machine &machine)
+	{
+		auto checkpoint = copyPages(machine, Machine::PageSet().set());
+		checkpoint.full = true;
+		return checkpoint;
+	}
+
+	bool loadCheckpoint(const std::string &fileName, Machine &machine, std::uint64_t key)
+	{
+		const int file = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+		if (file < 0)
+		{
+			return false;
+		}
+
+		struct stat status;
+		if (::fstat(file, &status) < 0 ||
+			status.st_size < static_cast<off_t>(sizeof(FileMagic)))
+		{
+			::close(file);
+			return false;
+		}
+
+		const std::size_t size = static_cast<std::size_t>(status.st_size);
+		void * const mapping = ::mmap(0, size, PROT_READ, MAP_PRIVATE, file, 0);
+		::close(file);
+		if (mapping == MAP_FAILED)
+		{
+			return false;
+		}
+
+		const char * const data = static_cast<const char *>(mapping);
+		bool loaded = false;
+		if (std::memcmp(data, FileMagic, sizeof(FileMagic)) == 0)
+		{
+			machine.memory.resize(MemorySizeInWords);
+
+			std::size_t position = sizeof(FileMagic);
+			while (const auto recordSize = applyRecord(
+				data + position,
+				size - position,
+				!loaded,
+				key,
+				machine))
+			{
+				position += recordSize;
+				loaded = true;
+			}
+		}
+
+		::munmap(mapping, size);
+		return loaded;
+	}
+
+
+	CheckpointWriter::CheckpointWriter()
+		: m_stopping(false)
+	{
+		m_statistics.checkpoints = 0;
+		m_statistics.bytes = 0;
+		m_statistics.failures = 0;
+		m_statistics.pending = 0;
+
+		m_thread = std::thread(&CheckpointWriter::work, this);
+	}
+
+	CheckpointWriter::~CheckpointWriter()
+	{
+		stop();
+	}
+
+	void CheckpointWriter::write(
+		std::string fileName,
+		MachineCheckpoint checkpoint,
+		std::shared_ptr<std::atomic<bool>> failed
+		)
+	{
+		Job job;
+		job.fileName = std::move(fileName);
+		job.checkpoint = std::move(checkpoint);
+		job.failed = std::move(failed);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push_back(std::move(job));
+		}
+		m_jobAvailable.notify_one();
+	}
+
+	CheckpointWriterStatistics CheckpointWriter::getStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		CheckpointWriterStatistics statistics = m_statistics;
+		statistics.pending = m_jobs.size();
+		return statistics;
+	}
+
+	void CheckpointWriter::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_jobAvailable.notify_one();
+
+		if (m_thread.joinable())
+		{
+			m_thread.join();
+		}
+	}
+
+	void CheckpointWriter::work()
+	{
+		for (;;)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				while (m_jobs.empty() &&
+					!m_stopping)
+				{
+					m_jobAvailable.wait(lock);
+				}
+
+				//the remaining jobs are written before stopping
+				if (m_jobs.empty())
+				{
+					return;
+				}
+
+				job = std::move(m_jobs.front());
+				m_jobs.pop_front();
+			}
+
+			std::uint64_t bytes = 0;
+			const bool success = append(job, bytes);
+			if (!success &&
+				job.failed)
+			{
+				*job.failed = true;
+			}
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (success)
+			{
+				++m_statistics.checkpoints;
+				m_statistics.bytes += bytes;
+			}
+			else
+			{
+				++m_statistics.failures;
+			}
+		}
+	}
+
+	bool CheckpointWriter::append(const Job &job, std::uint64_t &bytes)
+	{
+		const bool full = job.checkpoint.full;
+
+		//an incremental checkpoint is useless without the one before
+		if (!full &&
+			m_broken.count(job.fileName))
+		{
+			return false;
+		}
+
+		const auto record = serialize(job.checkpoint);
+		const std::string temporaryName = job.fileName + ".new";
+		const std::string &fileName = full ? temporaryName : job.fileName;
+
+		const int file = full ?
+			::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) :
+			::open(fileName.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+
+		bool success = (file >= 0);
+		if (success && full)
+		{
+			success = writeAll(file, FileMagic, sizeof(FileMagic));
+			bytes += sizeof(FileMagic);
+		}
+
+		if (success)
+		{
+			success = writeAll(file, record.data(), record.size()) &&
+				(::fdatasync(file) == 0);
+			bytes += record.size();
+		}
+
+		if (file >= 0)
+		{
+			success = (::close(file) == 0) && success;
+		}
+
+		if (success && full)
+		{
+			success = (::rename(temporaryName.c_str(), job.fileName.c_str()) == 0) &&
+				syncDirectoryOf(job.fileName);
+		}
+
+		if (success)
+		{
+			m_broken.erase(job.fileName);
+		}
+		else
+		{
+			m_broken.insert(job.fileName);
+		}
+		return success;
+	}
+
+
+	CheckpointDevice::CheckpointDevice(
+		CheckpointWriter &writer,
+		std::string fileName,
+		std::uint64_t interval
+		)
+		: m_writer(writer)
+		, m_fileName(std::move(fileName))
+		, m_interval(std::max<std::uint64_t>(interval, 1))
+		, m_failed(std::make_shared<std::atomic<bool>>(false))
+		, m_lastCycles(0)
+		, m_pagesSinceFull(0)
+		, m_started(false)
+		, m_needsFull(true)
+	{
+	}
+
+	void CheckpointDevice::beforeSlice(HostedMachine &machine)
+	{
+		if (!m_started)
+		{
+			machine.machine.trackDirtyPages = true;
+			m_lastCycles = machine.machine.cycles;
+			m_started = true;
+		}
+	}
+
+	void CheckpointDevice::afterSlice(HostedMachine &machine)
+	{
+		if (machine.machine.cycles - m_lastCycles >= m_interval)
+		{
+			checkpoint(machine);
+		}
+	}
+
+	void CheckpointDevice::checkpoint(HostedMachine &machine)
+	{
+		//the first checkpoint of a file is full, the pages written before
+		//tracking started are unknown
+		const bool full = m_needsFull ||
+			m_failed->exchange(false) ||
+			(m_pagesSinceFull > 4 * MemoryPageCount);
+
+		auto checkpoint = takeCheckpoint(machine.machine, full);
+		machine.machine.trackDirtyPages = true;
+		m_started = true;
+		m_lastCycles = machine.machine.cycles;
+		m_pagesSinceFull = full ? 0 : (m_pagesSinceFull + checkpoint.pageIds.size());
+		m_needsFull = false;
+		m_writer.write(m_fileName, std::move(checkpoint), m_failed);
+	}
+}
@@ -0,0 +1,139 @@
+#ifndef DCPUPP_SERVER_CHECKPOINT_HPP
+#define DCPUPP_SERVER_CHECKPOINT_HPP
+
+
+#include "scheduler.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace dcpupp
+{
+	//The registers of a machine and the pages written to since the previous
+	//checkpoint. A full checkpoint contains every page.
+	struct MachineCheckpoint
+	{
+		bool full;
+
+		//chosen by the writer, 0 unless changed after taking the checkpoint
+		std::uint64_t key;
+
+		std::uint64_t cycles;
+		std::uint64_t instructions;
+		Machine::Registers registers;
+		Word sp, pc, o;
+		bool skipNext;
+		std::vector<Word> pageIds;
+		std::vector<Word> pageContents;
+	};
+
+	//Takes the pages marked in dirtyPages and clears them. Has to be called
+	//by the thread which runs the machine.
+	MachineCheckpoint takeCheckpoint(Machine &machine, bool full);
+
+	//A full checkpoint which leaves dirtyPages alone.
+	MachineCheckpoint copyMachine(const Machine &machine);
+
+	//Puts the machine into the state of the last complete checkpoint in the
+	//file. Returns false if there is none. Checkpoints with another key are
+	//ignored.
+	bool loadCheckpoint(const std::string &fileName, Machine &machine, std::uint64_t key = 0);
+
+	struct CheckpointWriterStatistics
+	{
+		std::uint64_t checkpoints;
+		std::uint64_t bytes;
+		std::uint64_t failures;
+		std::size_t pending;
+	};
+
+	//Appends checkpoints to files on a thread of its own so that the workers
+	//never wait for the disk.
+	//
+	//A file starts with a full checkpoint which is followed by incremental
+	//ones. A full checkpoint goes to a new file which then replaces the old
+	//one. Every checkpoint is synced to the disk before the next one is
+	//written. A checkpoint which was not written completely is ignored when
+	//loading.
+	struct CheckpointWriter
+	{
+		CheckpointWriter();
+		~CheckpointWriter();
+
+		//failed is set if the checkpoint could not be written, so that the
+		//next one can be full
+		void write(
+			std::string fileName,
+			MachineCheckpoint checkpoint,
+			std::shared_ptr<std::atomic<bool>> failed = std::shared_ptr<std::atomic<bool>>()
+			);
+		CheckpointWriterStatistics getStatistics() const;
+
+		//waits until everything is written
+		void stop();
+
+	private:
+
+		struct Job
+		{
+			std::string fileName;
+			MachineCheckpoint checkpoint;
+			std::shared_ptr<std::atomic<bool>> failed;
+		};
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_jobAvailable;
+		std::deque<Job> m_jobs;
+		bool m_stopping;
+		CheckpointWriterStatistics m_statistics;
+		std::thread m_thread;
+
+		//files which are missing a checkpoint and need a full one next
+		std::set<std::string> m_broken;
+
+		void work();
+		bool append(const Job &job, std::uint64_t &bytes);
+	};
+
+	//Takes a checkpoint of a hosted machine every interval cycles.
+	//
+	//After the incremental checkpoints add up to more than a few times the
+	//size of the memory, the next one is full so that the file does not grow
+	//forever. After a checkpoint could not be written, the next one is full,
+	//too, because the incremental ones would be useless without it.
+	struct CheckpointDevice : IHostedDevice
+	{
+		explicit CheckpointDevice(
+			CheckpointWriter &writer,
+			std::string fileName,
+			std::uint64_t interval
+			);
+		virtual void beforeSlice(HostedMachine &machine);
+		virtual void afterSlice(HostedMachine &machine);
+
+		//Only when the machine is not running.
+		void checkpoint(HostedMachine &machine);
+
+	private:
+
+		CheckpointWriter &m_writer;
+		const std::string m_fileName;
+		const std::uint64_t m_interval;
+		const std::shared_ptr<std::atomic<bool>> m_failed;
+		std::uint64_t m_lastCycles;
+		std::size_t m_pagesSinceFull;
+		bool m_started;
+		bool m_needsFull;
+	};
+}
+
+
+#endif
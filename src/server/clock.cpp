@@ -0,0 +1,222 @@
+#include "clock.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		std::runtime_error makeSystemError(const char *what)
+		{
+			return std::runtime_error(std::string(what) + ": " + std::strerror(errno));
+		}
+		
+		int createTimer()
+		{
+			const int timer = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+			if (timer < 0)
+			{
+				throw makeSystemError("timerfd_create");
+			}
+			return timer;
+		}
+	}
+	
+	
+	InterruptDevice::InterruptDevice(std::shared_ptr<InterruptController> interrupts)
+		: m_interrupts(std::move(interrupts))
+	{
+	}
+	
+	void InterruptDevice::beforeSlice(HostedMachine &machine)
+	{
+		m_interrupts->deliver(machine.machine);
+	}
+	
+	void InterruptDevice::afterSlice(HostedMachine &machine)
+	{
+		//A halted machine would be parked with the lines which became
+		//deliverable during the slice, for example because the handler
+		//returned.
+		m_interrupts->deliver(machine.machine);
+	}
+	
+	
+	ClockDevice::ClockDevice(std::shared_ptr<InterruptController> interrupts)
+		: m_interrupts(std::move(interrupts))
+		, m_timer(createTimer())
+		, m_interval(0)
+		, m_ticks(0)
+	{
+	}
+	
+	ClockDevice::~ClockDevice()
+	{
+		::close(m_timer);
+	}
+	
+	void ClockDevice::beforeSlice(HostedMachine &machine)
+	{
+		const auto ticks = m_ticks.exchange(0);
+		if (ticks)
+		{
+			machine.machine.memory[ClockTicks] += static_cast<Word>(ticks);
+			machine.machine.markDirty(ClockTicks);
+		}
+	}
+	
+	void ClockDevice::afterSlice(HostedMachine &machine)
+	{
+		const Word interval = machine.machine.memory[ClockInterval];
+		if (interval == m_interval)
+		{
+			return;
+		}
+		
+		m_interval = interval;
+		
+		itimerspec spec;
+		std::memset(&spec, 0, sizeof(spec));
+		spec.it_interval.tv_sec = interval / 1000;
+		spec.it_interval.tv_nsec = (interval % 1000) * 1000000L;
+		spec.it_value = spec.it_interval;
+		::timerfd_settime(m_timer, 0, &spec, 0);
+	}
+	
+	int ClockDevice::getTimer() const
+	{
+		return m_timer;
+	}
+	
+	void ClockDevice::expired(std::uint64_t count)
+	{
+		m_ticks += count;
+		m_interrupts->raise(InterruptLine_Timer);
+	}
+	
+	
+	ClockServer::ClockServer(Scheduler &scheduler)
+		: m_scheduler(scheduler)
+		, m_epoll(-1)
+		, m_event(-1)
+		, m_stopping(false)
+	{
+		try
+		{
+			m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+			if (m_epoll < 0)
+			{
+				throw makeSystemError("epoll_create1");
+			}
+			
+			m_event = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (m_event < 0)
+			{
+				throw makeSystemError("eventfd");
+			}
+			
+			epoll_event event;
+			std::memset(&event, 0, sizeof(event));
+			event.events = EPOLLIN;
+			event.data.fd = m_event;
+			if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_event, &event) < 0)
+			{
+				throw makeSystemError("epoll_ctl");
+			}
+		}
+		catch (...)
+		{
+			if (m_event >= 0) ::close(m_event);
+			if (m_epoll >= 0) ::close(m_epoll);
+			throw;
+		}
+		
+		m_thread = std::thread(&ClockServer::run, this);
+	}
+	
+	ClockServer::~ClockServer()
+	{
+		stop();
+		::close(m_event);
+		::close(m_epoll);
+	}
+	
+	void ClockServer::addClock(HostedMachine::Id id, std::shared_ptr<ClockDevice> clock)
+	{
+		const int timer = clock->getTimer();
+		{
+			std::lock_guard<std::mutex> lock(m_clocksMutex);
+			Entry &entry = m_clocks[timer];
+			entry.id = id;
+			entry.clock = std::move(clock);
+		}
+		
+		epoll_event event;
+		std::memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.fd = timer;
+		if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, timer, &event) < 0)
+		{
+			throw makeSystemError("epoll_ctl");
+		}
+	}
+	
+	void ClockServer::stop()
+	{
+		m_stopping = true;
+		
+		const std::uint64_t one = 1;
+		const auto result = ::write(m_event, &one, sizeof(one));
+		(void)result;
+		
+		if (m_thread.joinable())
+		{
+			m_thread.join();
+		}
+	}
+	
+	void ClockServer::run()
+	{
+		std::vector<epoll_event> events(256);
+		while (!m_stopping)
+		{
+			const int count = ::epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), -1);
+			if (count < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				break;
+			}
+			
+			for (int i = 0; i < count; ++i)
+			{
+				const int fd = events[i].data.fd;
+				std::uint64_t expirations;
+				if (fd == m_event ||
+					::read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+				{
+					continue;
+				}
+				
+				Entry entry;
+				{
+					std::lock_guard<std::mutex> lock(m_clocksMutex);
+					entry = m_clocks[fd];
+				}
+				
+				entry.clock->expired(expirations);
+				m_scheduler.wake(entry.id);
+			}
+		}
+	}
+}
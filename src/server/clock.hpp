@@ -0,0 +1,97 @@
+#ifndef DCPUPP_SERVER_CLOCK_HPP
+#define DCPUPP_SERVER_CLOCK_HPP
+
+
+#include "scheduler.hpp"
+#include "emu/interrupts.hpp"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+
+namespace dcpupp
+{
+	enum
+	{
+		ClockAddress = 0x9020,
+		
+		//written by the program, milliseconds between two ticks or 0
+		ClockInterval = ClockAddress + 0,
+		
+		//incremented by the host on every tick
+		ClockTicks = ClockAddress + 1,
+	};
+	
+	//Delivers the interrupts of a hosted machine at the beginning and at the
+	//end of every slice. A machine which has been woken by a raise is put at
+	//the front of the queue of its worker, so an interrupt reaches a parked
+	//machine after at most one slice of another machine.
+	struct InterruptDevice : IHostedDevice
+	{
+		explicit InterruptDevice(std::shared_ptr<InterruptController> interrupts);
+		virtual void beforeSlice(HostedMachine &machine);
+		virtual void afterSlice(HostedMachine &machine);
+		
+	private:
+		
+		const std::shared_ptr<InterruptController> m_interrupts;
+	};
+	
+	//A timer of a hosted machine. The program sets ClockInterval and the
+	//ClockServer raises InterruptLine_Timer and wakes the machine whenever
+	//the interval has passed.
+	struct ClockDevice : IHostedDevice
+	{
+		explicit ClockDevice(std::shared_ptr<InterruptController> interrupts);
+		~ClockDevice();
+		virtual void beforeSlice(HostedMachine &machine);
+		virtual void afterSlice(HostedMachine &machine);
+		
+		int getTimer() const;
+		
+		//called by the ClockServer
+		void expired(std::uint64_t count);
+		
+	private:
+		
+		const std::shared_ptr<InterruptController> m_interrupts;
+		const int m_timer;
+		Word m_interval;
+		std::atomic<std::uint64_t> m_ticks;
+	};
+	
+	//Waits for the timers of all clocks with a single thread, so a clock
+	//costs nothing while its interval has not passed.
+	struct ClockServer
+	{
+		explicit ClockServer(Scheduler &scheduler);
+		~ClockServer();
+		
+		void addClock(HostedMachine::Id id, std::shared_ptr<ClockDevice> clock);
+		void stop();
+		
+	private:
+		
+		struct Entry
+		{
+			HostedMachine::Id id;
+			std::shared_ptr<ClockDevice> clock;
+		};
+		
+		Scheduler &m_scheduler;
+		int m_epoll;
+		int m_event;
+		std::atomic<bool> m_stopping;
+		std::mutex m_clocksMutex;
+		std::map<int, Entry> m_clocks;
+		std::thread m_thread;
+		
+		void run();
+	};
+}
+
+
+#endif
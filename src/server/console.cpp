@@ -0,0 +1,650 @@
+#include "console.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		enum
+		{
+			//A viewer which does not read its screen updates gets the whole
+			//screen again when it has caught up instead of every update.
+			MaxBacklog = 64 * 1024,
+		};
+
+		void appendWord(std::string &message, Word word)
+		{
+			message.push_back(static_cast<char>(word & 0xff));
+			message.push_back(static_cast<char>(word >> 8));
+		}
+
+		void appendRun(
+			std::string &message,
+			const std::vector<Word> &screen,
+			std::size_t begin,
+			std::size_t end)
+		{
+			appendWord(message, static_cast<Word>(begin));
+			appendWord(message, static_cast<Word>(end - begin));
+			for (auto i = begin; i < end; ++i)
+			{
+				appendWord(message, screen[i]);
+			}
+		}
+
+		std::string makeFullScreen(const std::vector<Word> &screen)
+		{
+			std::string message;
+			appendRun(message, screen, 0, screen.size());
+			return message;
+		}
+
+		std::string makeDiff(
+			const std::vector<Word> &previous,
+			const std::vector<Word> &current)
+		{
+			assert(previous.size() == current.size());
+
+			std::string message;
+			std::size_t i = 0;
+			while (i < current.size())
+			{
+				if (previous[i] == current[i])
+				{
+					++i;
+					continue;
+				}
+
+				//up to two unchanged words are sent as part of a run because
+				//the header of a new run is two words, too
+				std::size_t end = i + 1;
+				for (auto j = end; (j < current.size()) && (j <= end + 2); ++j)
+				{
+					if (previous[j] != current[j])
+					{
+						end = j + 1;
+					}
+				}
+
+				appendRun(message, current, i, end);
+				i = end;
+			}
+			return message;
+		}
+
+		std::runtime_error makeSystemError(const char *what)
+		{
+			return std::runtime_error(std::string(what) + ": " + std::strerror(errno));
+		}
+
+		bool wouldBlock()
+		{
+			return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+		}
+	}
+
+
+	Console::Console(
+		ConsoleServer &server,
+		Word videoAddress,
+		unsigned width,
+		unsigned height,
+		std::shared_ptr<InterruptController> interrupts
+		)
+		: m_server(server)
+		, m_videoAddress(videoAddress)
+		, m_interrupts(std::move(interrupts))
+		, m_screen(std::min<std::size_t>(width * height, MemorySizeInWords - videoAddress))
+		, m_dirty(false)
+		, m_viewed(false)
+	{
+	}
+
+	void Console::beforeSlice(HostedMachine &machine)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_keyboard.deliver(machine.machine) &&
+			m_interrupts)
+		{
+			m_interrupts->raise(InterruptLine_Keyboard);
+		}
+	}
+
+	void Console::afterSlice(HostedMachine &machine)
+	{
+		const auto video = machine.machine.memory.begin() + m_videoAddress;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (std::equal(m_screen.begin(), m_screen.end(), video))
+		{
+			return;
+		}
+
+		//the copy is kept up to date even without viewers so that a new
+		//viewer gets the current screen of a parked machine
+		std::copy(video, video + m_screen.size(), m_screen.begin());
+
+		if (m_viewed &&
+			!m_dirty)
+		{
+			m_dirty = true;
+			m_server.notifyChanged(machine.id);
+		}
+	}
+
+	void Console::type(const char *keys, std::size_t count)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			//0 means that there is no key
+			const auto key = static_cast<unsigned char>(keys[i]);
+			if (key != 0)
+			{
+				m_keyboard.keys.push_back(key);
+			}
+		}
+
+		//the latency of the interrupt is measured from here
+		if (m_interrupts)
+		{
+			m_interrupts->raise(InterruptLine_Keyboard);
+		}
+	}
+
+	std::vector<Word> Console::takeScreen()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_dirty = false;
+		return m_screen;
+	}
+
+	void Console::setViewed(bool viewed)
+	{
+		m_viewed = viewed;
+	}
+
+
+	ConsoleServer::ConsoleServer(
+		Scheduler &scheduler,
+		const std::string &socketPath
+		)
+		: m_scheduler(scheduler)
+		, m_socketPath(socketPath)
+		, m_listener(-1)
+		, m_epoll(-1)
+		, m_event(-1)
+		, m_stopping(false)
+	{
+		try
+		{
+			sockaddr_un address;
+			std::memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+			if (socketPath.size() >= sizeof(address.sun_path))
+			{
+				throw std::runtime_error("Socket path is too long");
+			}
+			std::copy(socketPath.begin(), socketPath.end(), address.sun_path);
+
+			m_listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			if (m_listener < 0)
+			{
+				throw makeSystemError("socket");
+			}
+
+			//a socket file left behind by a previous server
+			::unlink(socketPath.c_str());
+
+			if (::bind(m_listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0)
+			{
+				throw makeSystemError("bind");
+			}
+
+			if (::listen(m_listener, SOMAXCONN) < 0)
+			{
+				throw makeSystemError("listen");
+			}
+
+			m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+			if (m_epoll < 0)
+			{
+				throw makeSystemError("epoll_create1");
+			}
+
+			m_event = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (m_event < 0)
+			{
+				throw makeSystemError("eventfd");
+			}
+
+			const int fds[] = {m_listener, m_event};
+			for (std::size_t i = 0; i < 2; ++i)
+			{
+				epoll_event event;
+				std::memset(&event, 0, sizeof(event));
+				event.events = EPOLLIN;
+				event.data.fd = fds[i];
+				if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, fds[i], &event) < 0)
+				{
+					throw makeSystemError("epoll_ctl");
+				}
+			}
+		}
+		catch (...)
+		{
+			if (m_event >= 0) ::close(m_event);
+			if (m_epoll >= 0) ::close(m_epoll);
+			if (m_listener >= 0) ::close(m_listener);
+			throw;
+		}
+
+		m_thread = std::thread(&ConsoleServer::run, this);
+	}
+
+	ConsoleServer::~ConsoleServer()
+	{
+		stop();
+
+		for (auto v = m_viewers.begin(); v != m_viewers.end(); ++v)
+		{
+			::close(v->first);
+		}
+		::close(m_event);
+		::close(m_epoll);
+		::close(m_listener);
+		::unlink(m_socketPath.c_str());
+	}
+
+	void ConsoleServer::addConsole(HostedMachine::Id id, std::shared_ptr<Console> console)
+	{
+		std::lock_guard<std::mutex> lock(m_screensMutex);
+		Screen &screen = m_screens[id];
+		screen.console = std::move(console);
+		screen.sent = screen.console->takeScreen();
+	}
+
+	void ConsoleServer::notifyChanged(HostedMachine::Id id)
+	{
+		bool wasEmpty;
+		{
+			std::lock_guard<std::mutex> lock(m_changedMutex);
+			wasEmpty = m_changed.empty();
+			m_changed.push_back(id);
+		}
+
+		//the server thread takes all changes at once, so one signal is enough
+		if (wasEmpty)
+		{
+			signal();
+		}
+	}
+
+	void ConsoleServer::stop()
+	{
+		m_stopping = true;
+		signal();
+
+		if (m_thread.joinable())
+		{
+			m_thread.join();
+		}
+	}
+
+	void ConsoleServer::run()
+	{
+		std::vector<epoll_event> events(256);
+		while (!m_stopping)
+		{
+			const int count = ::epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), -1);
+			if (count < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				break;
+			}
+
+			for (int i = 0; i < count; ++i)
+			{
+				const auto &event = events[i];
+				const int fd = event.data.fd;
+
+				if (fd == m_listener)
+				{
+					accept();
+					continue;
+				}
+
+				if (fd == m_event)
+				{
+					std::uint64_t value;
+					while (::read(m_event, &value, sizeof(value)) > 0)
+					{
+					}
+					flushChanged();
+					continue;
+				}
+
+				//the viewer may have been closed by an earlier event
+				const auto v = m_viewers.find(fd);
+				if (v == m_viewers.end())
+				{
+					continue;
+				}
+				Viewer &viewer = *v->second;
+
+				if (event.events & EPOLLIN)
+				{
+					if (!receive(viewer))
+					{
+						continue;
+					}
+				}
+
+				if (event.events & (EPOLLERR | EPOLLHUP))
+				{
+					close(viewer);
+					continue;
+				}
+
+				if (event.events & EPOLLOUT)
+				{
+					sendOutput(viewer);
+				}
+			}
+		}
+	}
+
+	void ConsoleServer::accept()
+	{
+		for (;;)
+		{
+			const int fd = ::accept4(m_listener, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (fd < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				//EAGAIN when all connections are accepted, otherwise
+				//probably out of file descriptors which is retried later
+				return;
+			}
+
+			epoll_event event;
+			std::memset(&event, 0, sizeof(event));
+			event.events = EPOLLIN;
+			event.data.fd = fd;
+			if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) < 0)
+			{
+				::close(fd);
+				continue;
+			}
+
+			std::unique_ptr<Viewer> viewer(new Viewer);
+			viewer->fd = fd;
+			viewer->machine = 0;
+			viewer->attached = false;
+			viewer->resync = false;
+			viewer->writing = false;
+			m_viewers[fd] = std::move(viewer);
+		}
+	}
+
+	bool ConsoleServer::receive(Viewer &viewer)
+	{
+		char buffer[256];
+		for (;;)
+		{
+			const auto received = ::read(viewer.fd, buffer, sizeof(buffer));
+			if (received < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				if (wouldBlock())
+				{
+					return true;
+				}
+			}
+
+			if (received <= 0)
+			{
+				close(viewer);
+				return false;
+			}
+
+			const char *keys = buffer;
+			const char * const end = buffer + received;
+
+			if (!viewer.attached)
+			{
+				const auto newline = std::find(keys, end, '\n');
+				viewer.handshake.append(keys, newline);
+
+				if (newline == end)
+				{
+					//a machine id is never this long
+					if (viewer.handshake.size() > 32)
+					{
+						close(viewer);
+						return false;
+					}
+					continue;
+				}
+
+				if (!attach(viewer))
+				{
+					close(viewer);
+					return false;
+				}
+
+				keys = newline + 1;
+			}
+
+			if (keys != end)
+			{
+				getScreen(viewer.machine).console->type(keys, end - keys);
+				m_scheduler.wake(viewer.machine);
+			}
+		}
+	}
+
+	bool ConsoleServer::attach(Viewer &viewer)
+	{
+		const char * const begin = viewer.handshake.c_str();
+		char *end;
+		errno = 0;
+		const unsigned long id = std::strtoul(begin, &end, 10);
+		if ((end == begin) ||
+			(*end != '\0' && *end != '\r') ||
+			errno)
+		{
+			return false;
+		}
+
+		Screen *screen;
+		{
+			std::lock_guard<std::mutex> lock(m_screensMutex);
+			const auto s = m_screens.find(id);
+			if (s == m_screens.end())
+			{
+				return false;
+			}
+			screen = &s->second;
+		}
+
+		viewer.machine = id;
+		viewer.attached = true;
+		std::string().swap(viewer.handshake);
+
+		//Viewed before the screen is taken so that no change gets lost. The
+		//other viewers are brought up to date first so that everyone
+		//continues from the same screen.
+		screen->console->setViewed(true);
+		flush(*screen);
+
+		screen->viewers.push_back(&viewer);
+		send(viewer, makeFullScreen(screen->sent));
+		return true;
+	}
+
+	void ConsoleServer::flushChanged()
+	{
+		std::vector<HostedMachine::Id> changed;
+		{
+			std::lock_guard<std::mutex> lock(m_changedMutex);
+			changed.swap(m_changed);
+		}
+
+		for (auto c = changed.begin(); c != changed.end(); ++c)
+		{
+			flush(getScreen(*c));
+		}
+	}
+
+	void ConsoleServer::flush(Screen &screen)
+	{
+		auto current = screen.console->takeScreen();
+		const auto diff = makeDiff(screen.sent, current);
+		screen.sent.swap(current);
+
+		if (diff.empty())
+		{
+			return;
+		}
+
+		for (auto v = screen.viewers.begin(); v != screen.viewers.end(); ++v)
+		{
+			send(**v, diff);
+		}
+	}
+
+	void ConsoleServer::send(Viewer &viewer, const std::string &message)
+	{
+		if (viewer.resync)
+		{
+			return;
+		}
+
+		if (viewer.output.size() > MaxBacklog)
+		{
+			viewer.resync = true;
+			return;
+		}
+
+		//most of the time the whole message can be written immediately
+		std::size_t written = 0;
+		if (viewer.output.empty())
+		{
+			const auto result = ::send(viewer.fd, message.data(), message.size(), MSG_NOSIGNAL);
+			if (result < 0 &&
+				!wouldBlock())
+			{
+				//the error is reported by epoll
+				return;
+			}
+			written = std::max<ssize_t>(result, 0);
+		}
+
+		viewer.output.append(message, written, std::string::npos);
+		sendOutput(viewer);
+	}
+
+	void ConsoleServer::sendOutput(Viewer &viewer)
+	{
+		while (!viewer.output.empty())
+		{
+			const auto result = ::send(viewer.fd, viewer.output.data(), viewer.output.size(), MSG_NOSIGNAL);
+			if (result < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				if (!wouldBlock())
+				{
+					std::string().swap(viewer.output);
+					viewer.resync = false;
+				}
+				break;
+			}
+
+			viewer.output.erase(0, result);
+
+			if (viewer.output.empty() &&
+				viewer.resync)
+			{
+				viewer.resync = false;
+				viewer.output = makeFullScreen(getScreen(viewer.machine).sent);
+			}
+		}
+
+		//idle viewers keep no buffer
+		if (viewer.output.empty())
+		{
+			std::string().swap(viewer.output);
+		}
+
+		const bool writing = !viewer.output.empty();
+		if (writing != viewer.writing)
+		{
+			epoll_event event;
+			std::memset(&event, 0, sizeof(event));
+			event.events = writing ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+			event.data.fd = viewer.fd;
+			::epoll_ctl(m_epoll, EPOLL_CTL_MOD, viewer.fd, &event);
+			viewer.writing = writing;
+		}
+	}
+
+	void ConsoleServer::close(Viewer &viewer)
+	{
+		if (viewer.attached)
+		{
+			Screen &screen = getScreen(viewer.machine);
+			screen.viewers.erase(
+				std::find(screen.viewers.begin(), screen.viewers.end(), &viewer));
+			if (screen.viewers.empty())
+			{
+				screen.console->setViewed(false);
+			}
+		}
+
+		const int fd = viewer.fd;
+		::epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, 0);
+		::close(fd);
+		m_viewers.erase(fd);
+	}
+
+	ConsoleServer::Screen &ConsoleServer::getScreen(HostedMachine::Id id)
+	{
+		std::lock_guard<std::mutex> lock(m_screensMutex);
+		assert(m_screens.count(id));
+		return m_screens[id];
+	}
+
+	void ConsoleServer::signal()
+	{
+		const std::uint64_t one = 1;
+		const auto result = ::write(m_event, &one, sizeof(one));
+		(void)result;
+	}
+}
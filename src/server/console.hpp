@@ -0,0 +1,136 @@
+#ifndef DCPUPP_SERVER_CONSOLE_HPP
+#define DCPUPP_SERVER_CONSOLE_HPP
+
+
+#include "scheduler.hpp"
+#include "emu/interrupts.hpp"
+#include "emu/keyboard.hpp"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace dcpupp
+{
+	struct ConsoleServer;
+
+	//Video memory and keyboard of a hosted machine as seen by the
+	//ConsoleServer. The worker copies the video memory after every slice
+	//and delivers typed keys before it. Typed and delivered keys raise
+	//InterruptLine_Keyboard if there are interrupts.
+	struct Console : IHostedDevice
+	{
+		explicit Console(
+			ConsoleServer &server,
+			Word videoAddress,
+			unsigned width,
+			unsigned height,
+			std::shared_ptr<InterruptController> interrupts
+			);
+		virtual void beforeSlice(HostedMachine &machine);
+		virtual void afterSlice(HostedMachine &machine);
+
+		void type(const char *keys, std::size_t count);
+
+		//Copies the screen and allows the next change to notify the server.
+		std::vector<Word> takeScreen();
+		void setViewed(bool viewed);
+
+	private:
+
+		ConsoleServer &m_server;
+		const Word m_videoAddress;
+		const std::shared_ptr<InterruptController> m_interrupts;
+		std::mutex m_mutex;
+		KeyboardQueue m_keyboard;
+		std::vector<Word> m_screen;
+		bool m_dirty;
+		std::atomic<bool> m_viewed;
+	};
+
+	//Serves the consoles of hosted machines on a Unix domain socket with a
+	//single thread.
+	//
+	//A client sends the decimal id of a machine followed by a newline. Every
+	//byte sent after that is a key for that machine. The server sends the
+	//whole screen first and then only the parts which changed, each as
+	//little endian 16 bit words: offset, count, count characters.
+	//
+	//Nothing is done for a viewer as long as its screen does not change, so
+	//an idle viewer costs a socket and a few bytes.
+	struct ConsoleServer
+	{
+		explicit ConsoleServer(
+			Scheduler &scheduler,
+			const std::string &socketPath
+			);
+		~ConsoleServer();
+
+		void addConsole(HostedMachine::Id id, std::shared_ptr<Console> console);
+
+		//called by a console after its screen changed
+		void notifyChanged(HostedMachine::Id id);
+
+		void stop();
+
+	private:
+
+		struct Viewer
+		{
+			int fd;
+			HostedMachine::Id machine;
+			bool attached;
+			std::string handshake;
+			std::string output;
+
+			//the backlog was too long, send the whole screen when caught up
+			bool resync;
+
+			//waiting for the socket to become writable
+			bool writing;
+		};
+
+		struct Screen
+		{
+			std::shared_ptr<Console> console;
+			std::vector<Word> sent;
+			std::vector<Viewer *> viewers;
+		};
+
+		Scheduler &m_scheduler;
+		const std::string m_socketPath;
+		int m_listener;
+		int m_epoll;
+		int m_event;
+		std::atomic<bool> m_stopping;
+
+		std::mutex m_screensMutex;
+		std::map<HostedMachine::Id, Screen> m_screens;
+
+		std::mutex m_changedMutex;
+		std::vector<HostedMachine::Id> m_changed;
+
+		std::map<int, std::unique_ptr<Viewer>> m_viewers;
+		std::thread m_thread;
+
+		void run();
+		void accept();
+		bool receive(Viewer &viewer);
+		bool attach(Viewer &viewer);
+		void flushChanged();
+		void flush(Screen &screen);
+		void send(Viewer &viewer, const std::string &message);
+		void sendOutput(Viewer &viewer);
+		void close(Viewer &viewer);
+		Screen &getScreen(HostedMachine::Id id);
+		void signal();
+	};
+}
+
+
+#endif
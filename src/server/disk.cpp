@@ -0,0 +1,320 @@
+#include "disk.hpp"
+#include "emu/interrupts.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace dcpupp
+{
+	namespace
+	{
+		enum
+		{
+			SectorSizeInBytes = DiskSectorSizeInWords * 2,
+		};
+
+		std::runtime_error makeSystemError(const char *what)
+		{
+			return std::runtime_error(std::string(what) + ": " + std::strerror(errno));
+		}
+	}
+
+
+	DiskImage::DiskImage(const std::string &fileName)
+		: m_file(-1)
+		, m_mapping(0)
+		, m_sectorCount(0)
+		, m_stopping(false)
+	{
+		std::memset(&m_statistics, 0, sizeof(m_statistics));
+
+		m_file = ::open(fileName.c_str(), O_RDWR | O_CLOEXEC);
+		if (m_file < 0)
+		{
+			throw makeSystemError("open");
+		}
+
+		struct stat status;
+		if (::fstat(m_file, &status) < 0)
+		{
+			::close(m_file);
+			throw makeSystemError("fstat");
+		}
+
+		//a partial sector at the end is not used
+		m_sectorCount = static_cast<std::uint64_t>(status.st_size) / SectorSizeInBytes;
+		if (m_sectorCount)
+		{
+			void * const mapping = ::mmap(0, m_sectorCount * SectorSizeInBytes, PROT_READ, MAP_SHARED, m_file, 0);
+			if (mapping == MAP_FAILED)
+			{
+				::close(m_file);
+				throw makeSystemError("mmap");
+			}
+			m_mapping = static_cast<const char *>(mapping);
+		}
+
+		m_thread = std::thread(&DiskImage::work, this);
+	}
+
+	DiskImage::~DiskImage()
+	{
+		stop();
+
+		if (m_mapping)
+		{
+			::munmap(const_cast<char *>(m_mapping), m_sectorCount * SectorSizeInBytes);
+		}
+		::close(m_file);
+	}
+
+	std::uint64_t DiskImage::getSectorCount() const
+	{
+		return m_sectorCount;
+	}
+
+	void DiskImage::submit(std::shared_ptr<DiskRequest> request, Callback finished)
+	{
+		Job job;
+		job.request = std::move(request);
+		job.finished = std::move(finished);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push_back(std::move(job));
+		}
+		m_jobAvailable.notify_one();
+	}
+
+	DiskStatistics DiskImage::getStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_statistics;
+	}
+
+	void DiskImage::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_jobAvailable.notify_one();
+
+		if (m_thread.joinable())
+		{
+			m_thread.join();
+			::fdatasync(m_file);
+		}
+	}
+
+	void DiskImage::work()
+	{
+		for (;;)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				while (m_jobs.empty() &&
+					!m_stopping)
+				{
+					m_jobAvailable.wait(lock);
+				}
+
+				if (m_jobs.empty())
+				{
+					return;
+				}
+
+				job = std::move(m_jobs.front());
+				m_jobs.pop_front();
+			}
+
+			DiskRequest &request = *job.request;
+			request.failed = !execute(request);
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				++(request.write ? m_statistics.writes : m_statistics.reads);
+				if (request.failed)
+				{
+					++m_statistics.failures;
+				}
+				else
+				{
+					m_statistics.sectors += request.words.size() / DiskSectorSizeInWords;
+				}
+			}
+
+			job.finished();
+		}
+	}
+
+	bool DiskImage::execute(DiskRequest &request)
+	{
+		const std::uint64_t count = request.words.size() / DiskSectorSizeInWords;
+		if (request.sector >= m_sectorCount ||
+			count > m_sectorCount - request.sector)
+		{
+			return false;
+		}
+
+		const std::size_t size = request.words.size() * 2;
+		const std::uint64_t offset = request.sector * SectorSizeInBytes;
+
+		if (request.write)
+		{
+			std::vector<unsigned char> bytes(size);
+			for (std::size_t i = 0; i < request.words.size(); ++i)
+			{
+				bytes[i * 2] = static_cast<unsigned char>(request.words[i]);
+				bytes[i * 2 + 1] = static_cast<unsigned char>(request.words[i] >> 8);
+			}
+
+			//the kernel writes the pages back to the disk later
+			std::size_t written = 0;
+			while (written < size)
+			{
+				const auto result = ::pwrite(m_file, bytes.data() + written, size - written, offset + written);
+				if (result < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					return false;
+				}
+				written += static_cast<std::size_t>(result);
+			}
+			return true;
+		}
+
+		//page faults of the mapping only block this thread
+		const unsigned char * const bytes = reinterpret_cast<const unsigned char *>(m_mapping + offset);
+		for (std::size_t i = 0; i < request.words.size(); ++i)
+		{
+			request.words[i] = static_cast<Word>(bytes[i * 2] | (bytes[i * 2 + 1] << 8));
+		}
+		return true;
+	}
+
+
+	DiskDevice::DiskDevice(
+		Scheduler &scheduler,
+		std::shared_ptr<DiskImage> image
+		)
+		: m_scheduler(scheduler)
+		, m_image(std::move(image))
+		, m_destination(0)
+		, m_started(false)
+		, m_finished(std::make_shared<std::atomic<bool>>(false))
+	{
+	}
+
+	void DiskDevice::beforeSlice(HostedMachine &machine)
+	{
+		auto &memory = machine.machine.memory;
+
+		if (!m_started)
+		{
+			const auto size = m_image->getSectorCount();
+			memory[DiskSizeLow] = static_cast<Word>(size);
+			memory[DiskSizeHigh] = static_cast<Word>(size >> 16);
+			machine.machine.markDirty(DiskSizeLow, 2);
+			m_started = true;
+		}
+
+		//A machine which was resumed from a checkpoint can be busy with a
+		//request of the previous process. The data of a write may have been
+		//changed since, so the command fails and the program can repeat it.
+		if (!m_request &&
+			memory[DiskStatus] == DiskStatus_Busy)
+		{
+			complete(machine.machine, DiskStatus_Error);
+			return;
+		}
+
+		if (!m_request ||
+			!*m_finished)
+		{
+			return;
+		}
+
+		const auto request = std::move(m_request);
+		if (!request->failed &&
+			!request->write)
+		{
+			for (std::size_t i = 0; i < request->words.size(); ++i)
+			{
+				const Word address = static_cast<Word>(m_destination + i);
+				memory[address] = request->words[i];
+				machine.machine.markDirty(address);
+			}
+		}
+
+		complete(machine.machine, request->failed ? DiskStatus_Error : DiskStatus_Ok);
+	}
+
+	void DiskDevice::afterSlice(HostedMachine &machine)
+	{
+		auto &memory = machine.machine.memory;
+		const Word command = memory[DiskCommand];
+		if (m_request ||
+			!command ||
+			memory[DiskStatus] == DiskStatus_Busy)
+		{
+			return;
+		}
+
+		if (command != DiskCommand_Read &&
+			command != DiskCommand_Write)
+		{
+			complete(machine.machine, DiskStatus_Error);
+			return;
+		}
+
+		const auto request = std::make_shared<DiskRequest>();
+		request->write = (command == DiskCommand_Write);
+		request->sector = memory[DiskSectorLow] | (static_cast<std::uint64_t>(memory[DiskSectorHigh]) << 16);
+		request->words.resize(memory[DiskSectorCount] * DiskSectorSizeInWords);
+		request->failed = false;
+
+		m_destination = memory[DiskMemory];
+		if (request->write)
+		{
+			for (std::size_t i = 0; i < request->words.size(); ++i)
+			{
+				request->words[i] = memory[static_cast<Word>(m_destination + i)];
+			}
+		}
+
+		memory[DiskStatus] = DiskStatus_Busy;
+		machine.machine.markDirty(DiskStatus);
+
+		m_request = request;
+		*m_finished = false;
+
+		const auto finished = m_finished;
+		Scheduler &scheduler = m_scheduler;
+		const auto id = machine.id;
+		m_image->submit(request, [finished, &scheduler, id]()
+		{
+			*finished = true;
+			scheduler.wake(id);
+		});
+	}
+
+	void DiskDevice::complete(Machine &machine, Word status)
+	{
+		auto &memory = machine.memory;
+		memory[DiskStatus] = status;
+		memory[DiskCommand] = 0;
+		memory[InterruptPending] |= InterruptLine_Disk;
+		machine.markDirty(DiskCommand, 2);
+		machine.markDirty(InterruptPending);
+	}
+}
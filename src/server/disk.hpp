@@ -0,0 +1,152 @@
+#ifndef DCPUPP_SERVER_DISK_HPP
+#define DCPUPP_SERVER_DISK_HPP
+
+
+#include "scheduler.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace dcpupp
+{
+	enum
+	{
+		DiskAddress = 0x9040,
+
+		//the first sector of a transfer, 32 bit
+		DiskSectorLow = DiskAddress + 0,
+		DiskSectorHigh = DiskAddress + 1,
+
+		DiskMemory = DiskAddress + 2,
+		DiskSectorCount = DiskAddress + 3,
+
+		//written by the program to start a transfer, 0 when it is finished
+		DiskCommand = DiskAddress + 4,
+
+		DiskStatus = DiskAddress + 5,
+
+		//number of sectors of the disk, 32 bit
+		DiskSizeLow = DiskAddress + 6,
+		DiskSizeHigh = DiskAddress + 7,
+
+		//little endian words
+		DiskSectorSizeInWords = 256,
+	};
+
+	enum DiskCommandId
+	{
+		DiskCommand_Read = 1,
+		DiskCommand_Write = 2,
+	};
+
+	enum DiskStatusId
+	{
+		DiskStatus_Ok = 0,
+		DiskStatus_Busy = 1,
+		DiskStatus_Error = 2,
+	};
+
+	struct DiskRequest
+	{
+		bool write;
+		std::uint64_t sector;
+		std::vector<Word> words;
+		bool failed;
+	};
+
+	struct DiskStatistics
+	{
+		std::uint64_t reads;
+		std::uint64_t writes;
+		std::uint64_t sectors;
+		std::uint64_t failures;
+	};
+
+	//A host file divided into sectors which is read through a shared
+	//mapping and written with pwrite. All requests are executed one after
+	//another on a thread of its own, so a read sees every write which was
+	//requested before it and no worker ever waits for the disk.
+	struct DiskImage
+	{
+		typedef std::function<void ()> Callback;
+
+		explicit DiskImage(const std::string &fileName);
+		~DiskImage();
+
+		std::uint64_t getSectorCount() const;
+
+		//finished is called on the thread of the image
+		void submit(std::shared_ptr<DiskRequest> request, Callback finished);
+
+		DiskStatistics getStatistics() const;
+
+		//executes the remaining requests and syncs the file
+		void stop();
+
+	private:
+
+		struct Job
+		{
+			std::shared_ptr<DiskRequest> request;
+			Callback finished;
+		};
+
+		int m_file;
+		const char *m_mapping;
+		std::uint64_t m_sectorCount;
+		mutable std::mutex m_mutex;
+		std::condition_variable m_jobAvailable;
+		std::deque<Job> m_jobs;
+		bool m_stopping;
+		DiskStatistics m_statistics;
+		std::thread m_thread;
+
+		void work();
+		bool execute(DiskRequest &request);
+	};
+
+	//The disk of a hosted machine.
+	//
+	//A command written by the program is noticed after the slice. The
+	//device sets DiskStatus to DiskStatus_Busy and hands the request to the
+	//image. The data of a write is copied at once, so the program may change
+	//its memory while the disk is busy. When the image has finished, the
+	//machine is woken and the device completes the command before the next
+	//slice: DiskStatus is set, DiskCommand is cleared and InterruptLine_Disk
+	//becomes pending. A command which is still busy when the device is
+	//created, because the machine was resumed from a checkpoint, fails with
+	//DiskStatus_Error before the first slice.
+	struct DiskDevice : IHostedDevice
+	{
+		explicit DiskDevice(
+			Scheduler &scheduler,
+			std::shared_ptr<DiskImage> image
+			);
+		virtual void beforeSlice(HostedMachine &machine);
+		virtual void afterSlice(HostedMachine &machine);
+
+	private:
+
+		Scheduler &m_scheduler;
+		const std::shared_ptr<DiskImage> m_image;
+		std::shared_ptr<DiskRequest> m_request;
+		Word m_destination;
+		bool m_started;
+
+		//set by the thread of the image
+		std::shared_ptr<std::atomic<bool>> m_finished;
+
+		void complete(Machine &machine, Word status);
+	};
+}
+
+
+#endif
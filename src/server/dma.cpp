@@ -0,0 +1,15 @@
+#include "dma.hpp"
+#include "emu/dma.hpp"
+
+
+namespace dcpupp
+{
+	void DmaDevice::beforeSlice(HostedMachine &)
+	{
+	}
+	
+	void DmaDevice::afterSlice(HostedMachine &machine)
+	{
+		runDma(machine.machine);
+	}
+}
@@ -0,0 +1,21 @@
+#ifndef DCPUPP_SERVER_DMA_HPP
+#define DCPUPP_SERVER_DMA_HPP
+
+
+#include "scheduler.hpp"
+
+
+namespace dcpupp
+{
+	//Executes the transfers of a hosted machine after every slice (see
+	//runDma). A program which WAITs for InterruptLine_Dma ends its slice
+	//right away, so the transfer is finished before it runs again.
+	struct DmaDevice : IHostedDevice
+	{
+		virtual void beforeSlice(HostedMachine &machine);
+		virtual void afterSlice(HostedMachine &machine);
+	};
+}
+
+
+#endif
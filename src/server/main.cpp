@@ -0,0 +1,683 @@
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <csignal>
+#include <cstdio>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "checkpoint.hpp"
+#include "clock.hpp"
+#include "console.hpp"
+#include "disk.hpp"
+#include "dma.hpp"
+#include "memo.hpp"
+#include "profiler.hpp"
+#include "scheduler.hpp"
+#include "emu/factory.hpp"
+#include "emu/hypercalls.hpp"
+#include "emu/sharing.hpp"
+#include <sys/resource.h>
+using namespace std;
+using namespace dcpupp;
+
+static void printHelp()
+{
+	cout << "dcpud [-w<workers>] [-q<quantum>] [-n<instances>] [-r<runs>] [-p<priority>] [-c<cycle quota>] [-s<console socket>] [-k<checkpoint directory>] [-K<checkpoint interval>] [-m<result cache directory>] [-M<cached state interval>] [-i] [-d] [-o<hypercall log>] [-b<hypercall block file>] [-D<disk image>] [-P] [-g<profile file>] [-G<samples per second>] image..." << endl;
+}
+
+struct Options
+{
+	unsigned workerCount;
+	std::uint64_t quantum;
+	unsigned instances;
+	unsigned runs;
+	unsigned priority;
+	std::uint64_t cycleQuota;
+	std::string consoleSocket;
+	std::string checkpointDirectory;
+	std::uint64_t checkpointInterval;
+	std::string cacheDirectory;
+	std::uint64_t cacheInterval;
+	bool interrupts;
+	bool dma;
+	std::string logFileName;
+	std::string blockFileName;
+	std::string diskFileName;
+	bool performanceMonitor;
+	std::string profileFileName;
+	unsigned sampleRate;
+	
+	Options()
+		: workerCount(std::max(std::thread::hardware_concurrency(), 1u))
+		, quantum(10000)
+		, instances(1)
+		, runs(0)
+		, priority(1)
+		, cycleQuota(0)
+		, checkpointInterval(10000000)
+		, cacheInterval(10000000)
+		, interrupts(false)
+		, dma(false)
+		, performanceMonitor(false)
+		, sampleRate(1000)
+	{
+	}
+};
+
+//every console viewer needs a file descriptor
+static void raiseFileLimit()
+{
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+		limit.rlim_cur < limit.rlim_max)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+}
+
+static void printPageSharing(Scheduler &scheduler)
+{
+	vector<const Machine::Memory *> memories;
+	const auto machineCount = scheduler.getStatistics().machines;
+	for (std::size_t i = 0; i < machineCount; ++i)
+	{
+		//the memory of finished machines was recycled
+		const auto &memory = scheduler.getMachine(i).machine.memory;
+		if (!memory.empty())
+		{
+			memories.push_back(&memory);
+		}
+	}
+	
+	if (memories.empty())
+	{
+		return;
+	}
+	
+	const auto sharing = measurePageSharing(memories);
+	const auto saved = (sharing.pages - sharing.distinctPages) * sharing.pageSizeInBytes;
+	
+	//all zero pages but one could be shared
+	const auto savedZeros = (sharing.zeroPages ? (sharing.zeroPages - 1) : 0) * sharing.pageSizeInBytes;
+	fprintf(stderr, "%zu pages of %zu bytes, %zu distinct, %zu bytes per machine could be shared, %zu of them in zero pages\n",
+		sharing.pages,
+		sharing.pageSizeInBytes,
+		sharing.distinctPages,
+		saved / memories.size(),
+		savedZeros / memories.size());
+	
+	if (sharing.kernelMergingPages)
+	{
+		fprintf(stderr, "the kernel merged %zu pages of this process\n",
+			sharing.kernelMergingPages);
+	}
+	else if (sharing.systemSharingPages)
+	{
+		fprintf(stderr, "system-wide, not only this process: the kernel shares %zu pages as %zu pages\n",
+			sharing.systemSharingPages + sharing.systemSharedPages,
+			sharing.systemSharedPages);
+	}
+}
+
+static volatile std::sig_atomic_t stopRequested = 0;
+
+static void requestStop(int)
+{
+	stopRequested = 1;
+}
+
+int main(int argc, char **argv)
+{
+	const vector<string> args(argv + 1, argv + argc);
+	
+	vector<string> imageFileNames;
+	Options options;
+	
+	for (auto a = args.begin(); a != args.end(); ++a)
+	{
+		const auto &arg = *a;
+		assert(!arg.empty());
+		if (arg[0] == '-' &&
+			arg.size() >= 2)
+		{
+			switch (arg[1])
+			{
+			case 'w':
+				options.workerCount = stoi(arg.c_str() + 2);
+				break;
+				
+			case 'q':
+				options.quantum = stoull(arg.c_str() + 2);
+				break;
+				
+			case 'n':
+				options.instances = stoi(arg.c_str() + 2);
+				break;
+				
+			case 'r':
+				options.runs = stoi(arg.c_str() + 2);
+				break;
+				
+			case 'p':
+				options.priority = stoi(arg.c_str() + 2);
+				break;
+				
+			case 'c':
+				options.cycleQuota = stoull(arg.c_str() + 2);
+				break;
+				
+			case 's':
+				options.consoleSocket = arg.substr(2);
+				break;
+				
+			case 'k':
+				options.checkpointDirectory = arg.substr(2);
+				break;
+				
+			case 'K':
+				options.checkpointInterval = stoull(arg.c_str() + 2);
+				break;
+				
+			case 'm':
+				options.cacheDirectory = arg.substr(2);
+				break;
+				
+			case 'M':
+				options.cacheInterval = stoull(arg.c_str() + 2);
+				break;
+				
+			case 'i':
+				options.interrupts = true;
+				break;
+				
+			case 'd':
+				options.dma = true;
+				break;
+				
+			case 'o':
+				options.logFileName = arg.substr(2);
+				break;
+				
+			case 'b':
+				options.blockFileName = arg.substr(2);
+				break;
+				
+			case 'D':
+				options.diskFileName = arg.substr(2);
+				break;
+				
+			case 'P':
+				options.performanceMonitor = true;
+				break;
+				
+			case 'g':
+				options.profileFileName = arg.substr(2);
+				break;
+				
+			case 'G':
+				options.sampleRate = stoi(arg.c_str() + 2);
+				break;
+				
+			default:
+				cerr << "Invalid option '" << arg << "'";
+				return 1;
+			}
+		}
+		else
+		{
+			imageFileNames.push_back(arg);
+		}
+	}
+	
+	if (imageFileNames.empty())
+	{
+		printHelp();
+		return 0;
+	}
+	
+	MachineFactory factory;
+	vector<MachineFactory::TemplateId> images;
+	for (auto f = imageFileNames.begin(); f != imageFileNames.end(); ++f)
+	{
+		std::ifstream imageFile(f->c_str(), std::ios::binary);
+		if (!imageFile)
+		{
+			cerr << "Could not open file '" << *f << "'" << endl;
+			return 1;
+		}
+		
+		images.push_back(factory.addTemplate(readProgramFromFile(imageFile)));
+	}
+	
+	std::signal(SIGINT, requestStop);
+	std::signal(SIGTERM, requestStop);
+	
+	//finished machines are handled by the main thread
+	std::mutex finishedMutex;
+	std::condition_variable machineFinished;
+	vector<HostedMachine::Id> finishedIds;
+	
+	Scheduler scheduler(options.workerCount, options.quantum,
+		[&](HostedMachine::Id id)
+	{
+		{
+			std::lock_guard<std::mutex> lock(finishedMutex);
+			finishedIds.push_back(id);
+		}
+		machineFinished.notify_one();
+	});
+	
+	std::unique_ptr<ConsoleServer> consoleServer;
+	if (!options.consoleSocket.empty())
+	{
+		raiseFileLimit();
+		
+		try
+		{
+			consoleServer.reset(new ConsoleServer(scheduler, options.consoleSocket));
+		}
+		catch (const std::exception &e)
+		{
+			cerr << "Could not start the console server: " << e.what() << endl;
+			return 1;
+		}
+	}
+	
+	//interrupts and a clock for every machine
+	std::unique_ptr<ClockServer> clockServer;
+	vector<std::shared_ptr<InterruptController>> interrupts;
+	if (options.interrupts)
+	{
+		try
+		{
+			clockServer.reset(new ClockServer(scheduler));
+		}
+		catch (const std::exception &e)
+		{
+			cerr << "Could not start the clock server: " << e.what() << endl;
+			return 1;
+		}
+	}
+	
+	//HYP only calls the host if a log or a block file is given
+	std::unique_ptr<Hypercalls> hypercalls;
+	if (!options.logFileName.empty() ||
+		!options.blockFileName.empty())
+	{
+		std::shared_ptr<std::ostream> log;
+		if (!options.logFileName.empty())
+		{
+			log = std::make_shared<std::ofstream>(options.logFileName.c_str(), std::ios::binary | std::ios::app);
+			if (!*log)
+			{
+				cerr << "Could not open log file '" << options.logFileName << "'" << endl;
+				return 1;
+			}
+		}
+		
+		std::shared_ptr<std::istream> blocks;
+		if (!options.blockFileName.empty())
+		{
+			blocks = std::make_shared<std::ifstream>(options.blockFileName.c_str(), std::ios::binary);
+			if (!*blocks)
+			{
+				cerr << "Could not open block file '" << options.blockFileName << "'" << endl;
+				return 1;
+			}
+		}
+		
+		hypercalls.reset(new Hypercalls(createHostHypercalls(log, blocks)));
+	}
+	
+	//all machines share the disk
+	std::shared_ptr<DiskImage> disk;
+	if (!options.diskFileName.empty())
+	{
+		try
+		{
+			disk = std::make_shared<DiskImage>(options.diskFileName);
+		}
+		catch (const std::exception &e)
+		{
+			cerr << "Could not open disk image '" << options.diskFileName << "': " << e.what() << endl;
+			return 1;
+		}
+	}
+	
+	CheckpointWriter checkpointWriter;
+	vector<std::shared_ptr<CheckpointDevice>> checkpoints;
+	std::size_t resumed = 0;
+	
+	//only runs without input are repeatable
+	std::unique_ptr<ResultCache> cache;
+	if (!options.cacheDirectory.empty())
+	{
+		if (consoleServer ||
+			clockServer ||
+			hypercalls ||
+			disk ||
+			options.dma ||
+			options.performanceMonitor ||
+			!options.cycleQuota)
+		{
+			cerr << "The result cache needs a cycle quota and no consoles, clocks, hypercalls, DMA, disks or performance monitors" << endl;
+			return 1;
+		}
+		
+		cache.reset(new ResultCache(options.cacheDirectory, checkpointWriter));
+	}
+	//a profile per image
+	vector<vector<std::shared_ptr<ProfilerDevice>>> profilers(images.size());
+	const bool profiling = (!options.profileFileName.empty() && options.sampleRate);
+	
+	const std::uint64_t sliceSize = std::max<std::uint64_t>(options.quantum, 1) * std::max(options.priority, 1u);
+	const std::uint64_t cacheStride = std::max<std::uint64_t>(options.cacheInterval / sliceSize, 1);
+	
+	//the image of every machine by id
+	vector<std::size_t> machineImages;
+	
+	const auto addMachine = [&](std::size_t image)
+	{
+		Machine machine = factory.create(images[image]);
+		machine.hypercalls = hypercalls.get();
+		machine.performanceMonitor = options.performanceMonitor;
+		HostedDevices devices;
+		
+		//samples before the other devices change the machine
+		if (profiling)
+		{
+			const auto profiler = std::make_shared<ProfilerDevice>(
+				std::chrono::nanoseconds(1000000000 / options.sampleRate));
+			profilers[image].push_back(profiler);
+			devices.push_back(profiler);
+		}
+		
+		if (!options.checkpointDirectory.empty())
+		{
+			//the ids of the machines are the order in which they are added
+			const auto fileName = options.checkpointDirectory + "/" +
+				std::to_string(static_cast<unsigned long long>(checkpoints.size())) + ".ckpt";
+			if (loadCheckpoint(fileName, machine))
+			{
+				++resumed;
+			}
+			
+			checkpoints.push_back(std::make_shared<CheckpointDevice>(
+				checkpointWriter, fileName, options.checkpointInterval));
+			devices.push_back(checkpoints.back());
+		}
+		
+		if (cache)
+		{
+			const auto start = hashMachine(machine);
+			bool finished;
+			const auto slice = cache->restore(machine, start, sliceSize, options.cycleQuota, cacheStride, finished);
+			devices.push_back(std::make_shared<MemoizingDevice>(
+				*cache, start, sliceSize, options.cycleQuota, cacheStride, slice, finished));
+		}
+		
+		std::shared_ptr<InterruptController> machineInterrupts;
+		std::shared_ptr<ClockDevice> clock;
+		if (clockServer)
+		{
+			machineInterrupts = std::make_shared<InterruptController>();
+			interrupts.push_back(machineInterrupts);
+			clock = std::make_shared<ClockDevice>(machineInterrupts);
+			devices.push_back(clock);
+		}
+		
+		std::shared_ptr<Console> console;
+		if (consoleServer)
+		{
+			console = std::make_shared<Console>(*consoleServer, 0x8000, 32, 12, machineInterrupts);
+			devices.push_back(console);
+		}
+		
+		if (options.dma)
+		{
+			devices.push_back(std::make_shared<DmaDevice>());
+		}
+		
+		if (disk)
+		{
+			devices.push_back(std::make_shared<DiskDevice>(scheduler, disk));
+		}
+		
+		//after the devices which raise interrupts
+		if (machineInterrupts)
+		{
+			devices.push_back(std::make_shared<InterruptDevice>(machineInterrupts));
+		}
+		
+		//a resumed machine which waits for a lost disk request would never
+		//be woken to see it fail
+		const bool diskBusy = disk &&
+			(machine.memory[DiskStatus] == DiskStatus_Busy);
+		
+		const auto id = scheduler.add(std::move(machine), options.priority, options.cycleQuota, devices);
+		machineImages.push_back(image);
+		
+		if (diskBusy)
+		{
+			scheduler.wake(id);
+		}
+		
+		if (console)
+		{
+			consoleServer->addConsole(id, console);
+		}
+		
+		if (clock)
+		{
+			clockServer->addClock(id, clock);
+		}
+	};
+	
+	//a finished machine is replaced until every image had its runs
+	vector<unsigned> runsLeft(images.size(), (options.runs > options.instances) ? (options.runs - options.instances) : 0);
+	
+	for (std::size_t i = 0; i < images.size(); ++i)
+	{
+		for (unsigned n = 0; n < options.instances; ++n)
+		{
+			addMachine(i);
+		}
+	}
+	
+	{
+		const auto created = factory.getStatistics();
+		fprintf(stderr, "%llu machines created in %llu ns each, %llu blocks allocated, %llu reused\n",
+			static_cast<unsigned long long>(created.instantiations),
+			static_cast<unsigned long long>(created.instantiations ?
+				created.instantiationNanoseconds / created.instantiations : 0),
+			static_cast<unsigned long long>(created.allocatedBlocks),
+			static_cast<unsigned long long>(created.reusedBlocks));
+		
+		if (resumed)
+		{
+			fprintf(stderr, "%zu machines resumed from checkpoints\n", resumed);
+		}
+		
+		if (cache)
+		{
+			const auto cached = cache->getStatistics();
+			fprintf(stderr, "result cache: %llu hits, %llu partial hits, %llu misses, %llu cycles skipped\n",
+				static_cast<unsigned long long>(cached.hits),
+				static_cast<unsigned long long>(cached.partialHits),
+				static_cast<unsigned long long>(cached.misses),
+				static_cast<unsigned long long>(cached.skippedCycles));
+		}
+	}
+	
+	auto last = scheduler.getStatistics();
+	auto lastCreated = factory.getStatistics();
+	auto nextReport = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	while (!stopRequested)
+	{
+		vector<HostedMachine::Id> justFinished;
+		{
+			std::unique_lock<std::mutex> lock(finishedMutex);
+			machineFinished.wait_until(lock, nextReport, [&finishedIds]() { return !finishedIds.empty(); });
+			justFinished.swap(finishedIds);
+		}
+		
+		//The memory of a finished machine goes to the next run of the image.
+		//Without one the final state is kept for the checkpoints and the
+		//statistics at the end.
+		for (auto f = justFinished.begin(); f != justFinished.end(); ++f)
+		{
+			const auto image = machineImages[*f];
+			if (!runsLeft[image])
+			{
+				continue;
+			}
+			
+			HostedMachine &machine = scheduler.getMachine(*f);
+			if (!checkpoints.empty())
+			{
+				checkpoints[*f]->checkpoint(machine);
+			}
+			factory.recycle(machine.machine);
+			
+			--runsLeft[image];
+			addMachine(image);
+		}
+		
+		if (std::chrono::steady_clock::now() < nextReport)
+		{
+			continue;
+		}
+		nextReport += std::chrono::seconds(1);
+		
+		const auto current = scheduler.getStatistics();
+		fprintf(stderr, "%zu machines: %zu queued, %zu parked, %zu finished, "
+			"%llu cycles/s, %llu slices/s, %llu steals/s\n",
+			current.machines,
+			current.queued,
+			current.parked,
+			current.finished,
+			static_cast<unsigned long long>(current.cycles - last.cycles),
+			static_cast<unsigned long long>(current.slices - last.slices),
+			static_cast<unsigned long long>(current.steals - last.steals));
+		last = current;
+		
+		const auto created = factory.getStatistics();
+		const auto instantiations = created.instantiations - lastCreated.instantiations;
+		if (instantiations ||
+			created.freedBlocks != lastCreated.freedBlocks)
+		{
+			fprintf(stderr, "%llu machines created/s in %llu ns each, blocks: %llu allocated/s, %llu reused/s, %llu freed/s, %zu pooled\n",
+				static_cast<unsigned long long>(instantiations),
+				static_cast<unsigned long long>(instantiations ?
+					(created.instantiationNanoseconds - lastCreated.instantiationNanoseconds) / instantiations : 0),
+				static_cast<unsigned long long>(created.allocatedBlocks - lastCreated.allocatedBlocks),
+				static_cast<unsigned long long>(created.reusedBlocks - lastCreated.reusedBlocks),
+				static_cast<unsigned long long>(created.freedBlocks - lastCreated.freedBlocks),
+				created.pooledBlocks);
+		}
+		lastCreated = created;
+		
+		//Without consoles, clocks and disks nothing can wake a parked machine.
+		//A machine which finishes is reported before it stops being counted
+		//as running.
+		if (!consoleServer &&
+			!clockServer &&
+			!disk &&
+			scheduler.isIdle())
+		{
+			std::lock_guard<std::mutex> lock(finishedMutex);
+			if (finishedIds.empty())
+			{
+				break;
+			}
+		}
+	}
+	
+	//the workers use the consoles
+	scheduler.stop();
+	consoleServer.reset();
+	clockServer.reset();
+	
+	if (disk)
+	{
+		disk->stop();
+		
+		const auto statistics = disk->getStatistics();
+		fprintf(stderr, "disk: %llu reads, %llu writes, %llu sectors, %llu failed\n",
+			static_cast<unsigned long long>(statistics.reads),
+			static_cast<unsigned long long>(statistics.writes),
+			static_cast<unsigned long long>(statistics.sectors),
+			static_cast<unsigned long long>(statistics.failures));
+	}
+	
+	if (!interrupts.empty())
+	{
+		InterruptStatistics total = {0, 0, 0, 0};
+		for (auto i = interrupts.begin(); i != interrupts.end(); ++i)
+		{
+			const auto statistics = (*i)->getStatistics();
+			total.raised += statistics.raised;
+			total.delivered += statistics.delivered;
+			total.totalLatencyNanoseconds += statistics.totalLatencyNanoseconds;
+			total.maxLatencyNanoseconds = std::max(total.maxLatencyNanoseconds, statistics.maxLatencyNanoseconds);
+		}
+		fprintf(stderr, "%llu interrupts raised, %llu deliveries, latency %llu ns on average, %llu ns at most\n",
+			static_cast<unsigned long long>(total.raised),
+			static_cast<unsigned long long>(total.delivered),
+			static_cast<unsigned long long>(total.delivered ? total.totalLatencyNanoseconds / total.delivered : 0),
+			static_cast<unsigned long long>(total.maxLatencyNanoseconds));
+	}
+	
+	if (profiling)
+	{
+		std::ofstream profileFile(options.profileFileName.c_str());
+		std::uint64_t samples = 0;
+		for (std::size_t i = 0; i < images.size(); ++i)
+		{
+			Profile profile;
+			for (auto p = profilers[i].begin(); p != profilers[i].end(); ++p)
+			{
+				profile.merge((*p)->getProfile());
+			}
+			writeFoldedStacks(profileFile, profile, loadSymbols(imageFileNames[i]), imageFileNames[i]);
+			samples += profile.samples;
+		}
+		
+		if (profileFile)
+		{
+			fprintf(stderr, "%llu samples written to the profile\n",
+				static_cast<unsigned long long>(samples));
+		}
+		else
+		{
+			cerr << "Could not write profile '" << options.profileFileName << "'" << endl;
+		}
+	}
+	
+	//finished machines were saved before their memory was recycled
+	for (std::size_t i = 0; i < checkpoints.size(); ++i)
+	{
+		HostedMachine &machine = scheduler.getMachine(i);
+		if (!machine.machine.memory.empty())
+		{
+			checkpoints[i]->checkpoint(machine);
+		}
+	}
+	checkpointWriter.stop();
+	
+	if (!checkpoints.empty())
+	{
+		const auto written = checkpointWriter.getStatistics();
+		fprintf(stderr, "%llu checkpoints with %llu bytes written, %llu failed\n",
+			static_cast<unsigned long long>(written.checkpoints),
+			static_cast<unsigned long long>(written.bytes),
+			static_cast<unsigned long long>(written.failures));
+	}
+	
+	printPageSharing(scheduler);
+}
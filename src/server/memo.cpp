@@ -0,0 +1,165 @@
+#include "memo.hpp"
+#include "emu/hash.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <sys/stat.h>
+
+
+namespace dcpupp
+{
+	ResultCache::ResultCache(
+		std::string directory,
+		CheckpointWriter &writer
+		)
+		: m_directory(std::move(directory))
+		, m_writer(writer)
+		, m_hits(0)
+		, m_partialHits(0)
+		, m_misses(0)
+		, m_skippedCycles(0)
+	{
+	}
+
+	std::uint64_t ResultCache::restore(
+		Machine &machine,
+		std::uint64_t start,
+		std::uint64_t sliceSize,
+		std::uint64_t budget,
+		std::uint64_t stride,
+		bool &finished
+		)
+	{
+		const std::uint64_t startCycles = machine.cycles;
+		finished = false;
+
+		if (budget &&
+			loadCheckpoint(getFileName(start, sliceSize, 'f', budget), machine, start))
+		{
+			finished = true;
+			++m_hits;
+			m_skippedCycles += machine.cycles - startCycles;
+			return 0;
+		}
+
+		//every slice has at least sliceSize cycles, so there cannot be more
+		//complete slices than this within the budget
+		const std::uint64_t maxSlice = (budget > startCycles) ? ((budget - startCycles) / sliceSize) : 0;
+		for (std::uint64_t slice = maxSlice - maxSlice % stride; slice > 0; slice -= stride)
+		{
+			//most slices were never saved, a stat is much cheaper than copying
+			//the machine
+			const auto fileName = getFileName(start, sliceSize, 's', slice);
+			struct stat status;
+			if (::stat(fileName.c_str(), &status) != 0)
+			{
+				continue;
+			}
+			
+			Machine candidate(machine);
+			if (!loadCheckpoint(fileName, candidate, start))
+			{
+				continue;
+			}
+
+			//no slice until this one may have been shortened by the budget
+			if (candidate.cycles + sliceSize > budget)
+			{
+				continue;
+			}
+
+			m_skippedCycles += candidate.cycles - startCycles;
+			machine = std::move(candidate);
+			++m_partialHits;
+			return slice;
+		}
+
+		++m_misses;
+		return 0;
+	}
+
+	void ResultCache::saveFinal(const Machine &machine, std::uint64_t start, std::uint64_t sliceSize, std::uint64_t budget)
+	{
+		auto checkpoint = copyMachine(machine);
+		checkpoint.key = start;
+		m_writer.write(getFileName(start, sliceSize, 'f', budget), std::move(checkpoint));
+	}
+
+	void ResultCache::saveSlice(const Machine &machine, std::uint64_t start, std::uint64_t sliceSize, std::uint64_t slice)
+	{
+		auto checkpoint = copyMachine(machine);
+		checkpoint.key = start;
+		m_writer.write(getFileName(start, sliceSize, 's', slice), std::move(checkpoint));
+	}
+
+	ResultCacheStatistics ResultCache::getStatistics() const
+	{
+		ResultCacheStatistics statistics;
+		statistics.hits = m_hits;
+		statistics.partialHits = m_partialHits;
+		statistics.misses = m_misses;
+		statistics.skippedCycles = m_skippedCycles;
+		return statistics;
+	}
+
+	std::string ResultCache::getFileName(std::uint64_t start, std::uint64_t sliceSize, char kind, std::uint64_t value) const
+	{
+		//only the start state is hashed, the record repeats the hash as its
+		//key so that a file which was copied or renamed is not taken
+		char name[80];
+		std::snprintf(name, sizeof(name), "/%016llx-%llx-%llx.%c",
+			static_cast<unsigned long long>(start),
+			static_cast<unsigned long long>(sliceSize),
+			static_cast<unsigned long long>(value),
+			kind);
+		return m_directory + name;
+	}
+
+
+	MemoizingDevice::MemoizingDevice(
+		ResultCache &cache,
+		std::uint64_t start,
+		std::uint64_t sliceSize,
+		std::uint64_t budget,
+		std::uint64_t stride,
+		std::uint64_t slice,
+		bool finished
+		)
+		: m_cache(cache)
+		, m_start(start)
+		, m_sliceSize(sliceSize)
+		, m_budget(budget)
+		, m_stride(std::max<std::uint64_t>(stride, 1))
+		, m_slice(slice)
+		, m_cyclesBefore(0)
+		, m_finished(finished)
+	{
+	}
+
+	void MemoizingDevice::beforeSlice(HostedMachine &machine)
+	{
+		m_cyclesBefore = machine.machine.cycles;
+	}
+
+	void MemoizingDevice::afterSlice(HostedMachine &machine)
+	{
+		if (m_finished)
+		{
+			return;
+		}
+
+		++m_slice;
+
+		//a halted machine is parked for good because nothing gives it input
+		if (machine.machine.cycles >= m_budget ||
+			isHalted(machine.machine))
+		{
+			m_cache.saveFinal(machine.machine, m_start, m_sliceSize, m_budget);
+			m_finished = true;
+		}
+		else if (m_cyclesBefore + m_sliceSize <= m_budget &&
+			m_slice % m_stride == 0)
+		{
+			m_cache.saveSlice(machine.machine, m_start, m_sliceSize, m_slice);
+		}
+	}
+}
@@ -0,0 +1,97 @@
+#ifndef DCPUPP_SERVER_MEMO_HPP
+#define DCPUPP_SERVER_MEMO_HPP
+
+
+#include "checkpoint.hpp"
+#include "emu/hash.hpp"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+
+namespace dcpupp
+{
+	struct ResultCacheStatistics
+	{
+		std::uint64_t hits;
+		std::uint64_t partialHits;
+		std::uint64_t misses;
+		std::uint64_t skippedCycles;
+	};
+
+	//States of machines which run without any input, saved in files named
+	//after everything the run depends on: a hash of the state at the start,
+	//the size of the slices and the cycle budget or the number of the slice.
+	//
+	//When a run is finished the final state is saved. Every few slices an
+	//intermediate state is saved, too. An intermediate state does not
+	//depend on the budget as long as no slice before it was shortened to
+	//stay within the budget, so a longer run of the same machine can
+	//continue from it.
+	struct ResultCache
+	{
+		explicit ResultCache(
+			std::string directory,
+			CheckpointWriter &writer
+			);
+
+		//Puts the machine into the final state of the run or the latest
+		//saved state before it. Returns the number of slices which were
+		//skipped. finished is set if the run does not have to be executed.
+		std::uint64_t restore(
+			Machine &machine,
+			std::uint64_t start,
+			std::uint64_t sliceSize,
+			std::uint64_t budget,
+			std::uint64_t stride,
+			bool &finished
+			);
+
+		void saveFinal(const Machine &machine, std::uint64_t start, std::uint64_t sliceSize, std::uint64_t budget);
+		void saveSlice(const Machine &machine, std::uint64_t start, std::uint64_t sliceSize, std::uint64_t slice);
+
+		ResultCacheStatistics getStatistics() const;
+
+	private:
+
+		const std::string m_directory;
+		CheckpointWriter &m_writer;
+		std::atomic<std::uint64_t> m_hits;
+		std::atomic<std::uint64_t> m_partialHits;
+		std::atomic<std::uint64_t> m_misses;
+		std::atomic<std::uint64_t> m_skippedCycles;
+
+		std::string getFileName(std::uint64_t start, std::uint64_t sliceSize, char kind, std::uint64_t value) const;
+	};
+
+	//Saves the states of a hosted machine in a ResultCache. The slices of
+	//the machine have to be exactly sliceSize unless shortened by the budget.
+	struct MemoizingDevice : IHostedDevice
+	{
+		explicit MemoizingDevice(
+			ResultCache &cache,
+			std::uint64_t start,
+			std::uint64_t sliceSize,
+			std::uint64_t budget,
+			std::uint64_t stride,
+			std::uint64_t slice,
+			bool finished
+			);
+		virtual void beforeSlice(HostedMachine &machine);
+		virtual void afterSlice(HostedMachine &machine);
+
+	private:
+
+		ResultCache &m_cache;
+		const std::uint64_t m_start;
+		const std::uint64_t m_sliceSize;
+		const std::uint64_t m_budget;
+		const std::uint64_t m_stride;
+		std::uint64_t m_slice;
+		std::uint64_t m_cyclesBefore;
+		bool m_finished;
+	};
+}
+
+
+#endif
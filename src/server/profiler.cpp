@@ -0,0 +1,36 @@
+#include "profiler.hpp"
+
+
+namespace dcpupp
+{
+	ProfilerDevice::ProfilerDevice(std::chrono::nanoseconds interval)
+		: m_interval(interval)
+		, m_elapsed(0)
+	{
+	}
+	
+	void ProfilerDevice::beforeSlice(HostedMachine &)
+	{
+		m_sliceStart = std::chrono::steady_clock::now();
+	}
+	
+	void ProfilerDevice::afterSlice(HostedMachine &machine)
+	{
+		//parked and queued machines have no slices, so only running time
+		//is sampled
+		m_elapsed += std::chrono::steady_clock::now() - m_sliceStart;
+		if (m_elapsed < m_interval)
+		{
+			return;
+		}
+		
+		const auto intervals = m_elapsed / m_interval;
+		m_profile.sample(machine.machine, static_cast<std::uint64_t>(intervals));
+		m_elapsed -= intervals * m_interval;
+	}
+	
+	const Profile &ProfilerDevice::getProfile() const
+	{
+		return m_profile;
+	}
+}
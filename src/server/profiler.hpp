@@ -0,0 +1,38 @@
+#ifndef DCPUPP_SERVER_PROFILER_HPP
+#define DCPUPP_SERVER_PROFILER_HPP
+
+
+#include "scheduler.hpp"
+#include "emu/profiler.hpp"
+#include <chrono>
+
+
+namespace dcpupp
+{
+	//Samples a hosted machine at the end of a slice when the interval has
+	//passed in the running time of the machine. A slice can be longer than
+	//the interval, so a sample counts for every interval which passed since
+	//the previous one. Only the worker which runs the machine touches the
+	//profile, so it needs no lock.
+	struct ProfilerDevice : IHostedDevice
+	{
+		explicit ProfilerDevice(std::chrono::nanoseconds interval);
+		virtual void beforeSlice(HostedMachine &machine);
+		virtual void afterSlice(HostedMachine &machine);
+		
+		//Only when the machine is not running.
+		const Profile &getProfile() const;
+		
+	private:
+		
+		const std::chrono::nanoseconds m_interval;
+		std::chrono::steady_clock::time_point m_sliceStart;
+		
+		//running time which was not sampled yet
+		std::chrono::nanoseconds m_elapsed;
+		Profile m_profile;
+	};
+}
+
+
+#endif
@@ -0,0 +1,360 @@
+#include "scheduler.hpp"
+#include <algorithm>
+#include <cassert>
+
+
+namespace dcpupp
+{
+	IHostedDevice::~IHostedDevice()
+	{
+	}
+	
+	
+	HostedMachine::HostedMachine(
+		Id id,
+		Machine machine,
+		unsigned priority,
+		std::uint64_t cycleQuota,
+		HostedDevices devices
+		)
+		: id(id)
+		, machine(std::move(machine))
+		, priority(std::max(priority, 1u))
+		, cycleQuota(cycleQuota)
+		, devices(std::move(devices))
+		, m_state(HMS_Queued)
+		, m_parkRequested(false)
+		, m_wakeRequested(false)
+		, m_worker(0)
+	{
+	}
+	
+	HostedMachineState HostedMachine::getState() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_state;
+	}
+	
+	
+	Scheduler::Scheduler(
+		unsigned workerCount,
+		std::uint64_t quantum,
+		FinishedHandler finished
+		)
+		: m_quantum(std::max<std::uint64_t>(quantum, 1))
+		, m_finished(std::move(finished))
+		, m_queued(0)
+		, m_running(0)
+		, m_stopping(false)
+		, m_nextWorker(0)
+		, m_cycles(0)
+		, m_slices(0)
+		, m_steals(0)
+	{
+		workerCount = std::max(workerCount, 1u);
+		for (unsigned i = 0; i < workerCount; ++i)
+		{
+			m_workers.push_back(std::unique_ptr<Worker>(new Worker));
+		}
+		
+		for (unsigned i = 0; i < workerCount; ++i)
+		{
+			m_threads.push_back(std::thread(&Scheduler::work, this, i));
+		}
+	}
+	
+	Scheduler::~Scheduler()
+	{
+		stop();
+	}
+	
+	HostedMachine::Id Scheduler::add(
+		Machine machine,
+		unsigned priority,
+		std::uint64_t cycleQuota,
+		HostedDevices devices
+		)
+	{
+		HostedMachine *added;
+		unsigned worker;
+		{
+			std::lock_guard<std::mutex> lock(m_machinesMutex);
+			const auto id = m_machines.size();
+			m_machines.push_back(std::unique_ptr<HostedMachine>(
+				new HostedMachine(id, std::move(machine), priority, cycleQuota, std::move(devices))));
+			added = m_machines.back().get();
+			worker = (m_nextWorker++ % m_workers.size());
+			added->m_worker = worker;
+		}
+		
+		push(*added, worker);
+		return added->id;
+	}
+	
+	void Scheduler::park(HostedMachine::Id id)
+	{
+		HostedMachine &machine = getMachine(id);
+		std::lock_guard<std::mutex> lock(machine.m_mutex);
+		if (machine.m_state == HMS_Queued ||
+			machine.m_state == HMS_Running)
+		{
+			machine.m_parkRequested = true;
+			machine.m_wakeRequested = false;
+		}
+	}
+	
+	void Scheduler::wake(HostedMachine::Id id)
+	{
+		HostedMachine &machine = getMachine(id);
+		unsigned worker;
+		{
+			std::lock_guard<std::mutex> lock(machine.m_mutex);
+			machine.m_parkRequested = false;
+			
+			if (machine.m_state == HMS_Running ||
+				machine.m_state == HMS_Queued)
+			{
+				machine.m_wakeRequested = true;
+			}
+			
+			if (machine.m_state != HMS_Parked)
+			{
+				return;
+			}
+			
+			machine.m_state = HMS_Queued;
+			machine.m_wakeRequested = true;
+			worker = machine.m_worker;
+		}
+		
+		//a woken machine usually reacts to an event, so it runs next
+		push(machine, worker, true);
+	}
+	
+	HostedMachine &Scheduler::getMachine(HostedMachine::Id id)
+	{
+		std::lock_guard<std::mutex> lock(m_machinesMutex);
+		assert(id < m_machines.size());
+		return *m_machines[id];
+	}
+	
+	SchedulerStatistics Scheduler::getStatistics() const
+	{
+		SchedulerStatistics statistics;
+		statistics.cycles = m_cycles;
+		statistics.slices = m_slices;
+		statistics.steals = m_steals;
+		statistics.queued = statistics.parked = statistics.finished = 0;
+		
+		std::lock_guard<std::mutex> lock(m_machinesMutex);
+		statistics.machines = m_machines.size();
+		for (auto m = m_machines.begin(); m != m_machines.end(); ++m)
+		{
+			switch ((*m)->getState())
+			{
+			case HMS_Queued: ++statistics.queued; break;
+			case HMS_Parked: ++statistics.parked; break;
+			case HMS_Finished: ++statistics.finished; break;
+			default: break;
+			}
+		}
+		return statistics;
+	}
+	
+	bool Scheduler::isIdle() const
+	{
+		return (m_queued == 0) && (m_running == 0);
+	}
+	
+	void Scheduler::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_waitMutex);
+			m_stopping = true;
+		}
+		m_workAvailable.notify_all();
+		
+		for (auto t = m_threads.begin(); t != m_threads.end(); ++t)
+		{
+			if (t->joinable())
+			{
+				t->join();
+			}
+		}
+	}
+	
+	void Scheduler::work(unsigned worker)
+	{
+		while (HostedMachine * const machine = take(worker))
+		{
+			{
+				std::lock_guard<std::mutex> lock(machine->m_mutex);
+				
+				//a halted machine is only run when it was woken
+				if (machine->m_parkRequested ||
+					(isHalted(machine->machine) && !machine->m_wakeRequested))
+				{
+					machine->m_parkRequested = false;
+					machine->m_state = HMS_Parked;
+					--m_running;
+					continue;
+				}
+				machine->m_state = HMS_Running;
+				
+				//a wake during the slice has to survive until the next one
+				machine->m_wakeRequested = false;
+			}
+			
+			runSlice(*machine);
+			
+			bool requeue = false;
+			bool finished = false;
+			{
+				std::lock_guard<std::mutex> lock(machine->m_mutex);
+				if (machine->cycleQuota &&
+					machine->machine.cycles >= machine->cycleQuota)
+				{
+					machine->m_state = HMS_Finished;
+					finished = true;
+				}
+				else if (machine->m_parkRequested ||
+					(isHalted(machine->machine) && !machine->m_wakeRequested))
+				{
+					machine->m_state = HMS_Parked;
+				}
+				else
+				{
+					machine->m_state = HMS_Queued;
+					machine->m_worker = worker;
+					requeue = true;
+				}
+				
+				machine->m_parkRequested = false;
+			}
+			
+			//stolen machines stay with the worker which stole them
+			if (requeue)
+			{
+				push(*machine, worker);
+			}
+			
+			//still counted as running, so the machine is never idle before
+			//the handler knows about it
+			if (finished &&
+				m_finished)
+			{
+				m_finished(machine->id);
+			}
+			
+			--m_running;
+		}
+	}
+	
+	HostedMachine *Scheduler::take(unsigned worker)
+	{
+		for (;;)
+		{
+			if (m_stopping)
+			{
+				return 0;
+			}
+			
+			if (HostedMachine * const own = pop(worker, false))
+			{
+				return own;
+			}
+			
+			for (std::size_t i = 1; i < m_workers.size(); ++i)
+			{
+				const unsigned victim = static_cast<unsigned>((worker + i) % m_workers.size());
+				if (HostedMachine * const stolen = pop(victim, true))
+				{
+					++m_steals;
+					return stolen;
+				}
+			}
+			
+			std::unique_lock<std::mutex> lock(m_waitMutex);
+			while (m_queued == 0 &&
+				!m_stopping)
+			{
+				m_workAvailable.wait(lock);
+			}
+		}
+	}
+	
+	HostedMachine *Scheduler::pop(unsigned worker, bool steal)
+	{
+		Worker &w = *m_workers[worker];
+		std::lock_guard<std::mutex> lock(w.mutex);
+		if (w.queue.empty())
+		{
+			return 0;
+		}
+		
+		HostedMachine *machine;
+		if (steal)
+		{
+			machine = w.queue.back();
+			w.queue.pop_back();
+		}
+		else
+		{
+			machine = w.queue.front();
+			w.queue.pop_front();
+		}
+		
+		//counted as running before it is not counted as queued anymore so that
+		//isIdle never sees a machine in neither state
+		++m_running;
+		--m_queued;
+		return machine;
+	}
+	
+	void Scheduler::push(HostedMachine &machine, unsigned worker, bool front)
+	{
+		//counted first so that a pop never makes the counter negative
+		{
+			std::lock_guard<std::mutex> lock(m_waitMutex);
+			++m_queued;
+		}
+		
+		{
+			Worker &w = *m_workers[worker];
+			std::lock_guard<std::mutex> lock(w.mutex);
+			if (front)
+			{
+				w.queue.push_front(&machine);
+			}
+			else
+			{
+				w.queue.push_back(&machine);
+			}
+		}
+		m_workAvailable.notify_one();
+	}
+	
+	void Scheduler::runSlice(HostedMachine &machine)
+	{
+		std::uint64_t budget = m_quantum * machine.priority;
+		if (machine.cycleQuota)
+		{
+			//a machine can start beyond its quota when it was restored
+			budget = (machine.machine.cycles < machine.cycleQuota) ?
+				std::min(budget, machine.cycleQuota - machine.machine.cycles) : 0;
+		}
+		
+		for (auto d = machine.devices.begin(); d != machine.devices.end(); ++d)
+		{
+			(*d)->beforeSlice(machine);
+		}
+		
+		m_cycles += machine.machine.runSlice(budget);
+		++m_slices;
+		
+		for (auto d = machine.devices.begin(); d != machine.devices.end(); ++d)
+		{
+			(*d)->afterSlice(machine);
+		}
+	}
+}
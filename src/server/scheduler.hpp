@@ -0,0 +1,169 @@
+#ifndef DCPUPP_SERVER_SCHEDULER_HPP
+#define DCPUPP_SERVER_SCHEDULER_HPP
+
+
+#include "emu/machine.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace dcpupp
+{
+	enum HostedMachineState
+	{
+		HMS_Queued,
+		HMS_Running,
+		HMS_Parked,
+		HMS_Finished,
+	};
+	
+	struct HostedMachine;
+	
+	//Something outside of the machine which is updated between two slices.
+	//The worker which runs the machine calls it, so it has exclusive access
+	//to the machine.
+	struct IHostedDevice
+	{
+		virtual ~IHostedDevice();
+		virtual void beforeSlice(HostedMachine &machine) = 0;
+		virtual void afterSlice(HostedMachine &machine) = 0;
+	};
+	
+	typedef std::vector<std::shared_ptr<IHostedDevice>> HostedDevices;
+	
+	struct HostedMachine
+	{
+		typedef std::size_t Id;
+		
+		Id id;
+		Machine machine;
+		
+		//share of the cycles compared to other machines
+		unsigned priority;
+		
+		//the machine is finished after this many cycles, 0 for no limit
+		std::uint64_t cycleQuota;
+		
+		HostedDevices devices;
+		
+		explicit HostedMachine(
+			Id id,
+			Machine machine,
+			unsigned priority,
+			std::uint64_t cycleQuota,
+			HostedDevices devices
+			);
+		HostedMachineState getState() const;
+		
+	private:
+	
+		friend struct Scheduler;
+		
+		mutable std::mutex m_mutex;
+		HostedMachineState m_state;
+		bool m_parkRequested;
+		bool m_wakeRequested;
+		unsigned m_worker;
+	};
+	
+	struct SchedulerStatistics
+	{
+		std::uint64_t cycles;
+		std::uint64_t slices;
+		std::uint64_t steals;
+		std::size_t machines;
+		std::size_t queued;
+		std::size_t parked;
+		std::size_t finished;
+	};
+	
+	//Runs hosted machines on a fixed number of worker threads.
+	//
+	//Every worker has its own queue of machines. A machine runs for a slice
+	//of quantum * priority cycles and is then put at the end of the queue of
+	//the same worker, so every machine gets cycles in proportion to its
+	//priority. A worker with an empty queue takes machines from the back of
+	//the other queues. A worker without any work waits on a condition
+	//variable.
+	//
+	//Parked machines are in no queue, so they cost nothing until they are
+	//woken. A machine parks itself when it halts (see isHalted). A woken
+	//machine is put at the front of the queue.
+	//
+	//The worker calls finished when a machine has used up its cycle quota.
+	//The scheduler does not touch that machine anymore, so its memory can
+	//be used for another one.
+	struct Scheduler
+	{
+		typedef std::function<void (HostedMachine::Id)> FinishedHandler;
+		
+		explicit Scheduler(
+			unsigned workerCount,
+			std::uint64_t quantum,
+			FinishedHandler finished = FinishedHandler()
+			);
+		~Scheduler();
+		
+		HostedMachine::Id add(
+			Machine machine,
+			unsigned priority = 1,
+			std::uint64_t cycleQuota = 0,
+			HostedDevices devices = HostedDevices()
+			);
+		
+		//The machine is not run anymore after its current slice.
+		void park(HostedMachine::Id id);
+		void wake(HostedMachine::Id id);
+		
+		HostedMachine &getMachine(HostedMachine::Id id);
+		SchedulerStatistics getStatistics() const;
+		
+		//true if no machine is queued or running
+		bool isIdle() const;
+		
+		void stop();
+		
+	private:
+	
+		struct Worker
+		{
+			std::mutex mutex;
+			std::deque<HostedMachine *> queue;
+		};
+		
+		const std::uint64_t m_quantum;
+		const FinishedHandler m_finished;
+		std::vector<std::unique_ptr<Worker>> m_workers;
+		std::vector<std::thread> m_threads;
+		
+		mutable std::mutex m_machinesMutex;
+		std::deque<std::unique_ptr<HostedMachine>> m_machines;
+		
+		std::mutex m_waitMutex;
+		std::condition_variable m_workAvailable;
+		std::atomic<std::size_t> m_queued;
+		std::atomic<std::size_t> m_running;
+		std::atomic<bool> m_stopping;
+		unsigned m_nextWorker;
+		
+		std::atomic<std::uint64_t> m_cycles;
+		std::atomic<std::uint64_t> m_slices;
+		std::atomic<std::uint64_t> m_steals;
+		
+		void work(unsigned worker);
+		HostedMachine *take(unsigned worker);
+		HostedMachine *pop(unsigned worker, bool steal);
+		void push(HostedMachine &machine, unsigned worker, bool front = false);
+		void runSlice(HostedMachine &machine);
+	};
+}
+
+
+#endif
@@ -0,0 +1,56 @@
+#include "emu/machine.hpp"
+#include <cstdio>
+using namespace dcpupp;
+
+
+namespace
+{
+	//a program which consists of one instruction repeated over the whole
+	//memory has to use up a budget like any other
+	bool runFilled(Word instruction)
+	{
+		Machine::Memory memory(MemorySizeInWords, instruction);
+		Machine machine(memory);
+		
+		const std::uint64_t budget = 1000;
+		const std::uint64_t cycles = machine.runSlice(budget);
+		if (cycles < budget ||
+			machine.cycles != cycles)
+		{
+			std::printf("0x%04x: %llu of %llu cycles\n",
+				instruction,
+				static_cast<unsigned long long>(cycles),
+				static_cast<unsigned long long>(budget));
+			return false;
+		}
+		return true;
+	}
+}
+
+
+int main()
+{
+	unsigned failures = 0;
+	
+	//zeroed memory
+	if (!runFilled(0x0000))
+	{
+		++failures;
+	}
+	
+	//the reserved non-basic operations with a literal argument
+	for (unsigned operation = NBOp_Hyp + 1; operation < 64; ++operation)
+	{
+		if (!runFilled(static_cast<Word>((operation << 4) | ((Arg_SmallLiteral + 1) << 10))))
+		{
+			++failures;
+		}
+	}
+	
+	if (failures)
+	{
+		return 1;
+	}
+	std::printf("every instruction takes cycles\n");
+	return 0;
+}
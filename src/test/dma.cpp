@@ -0,0 +1,195 @@
+#include "emu/dma.hpp"
+#include "emu/interrupts.hpp"
+#include <cstdio>
+#include <random>
+using namespace dcpupp;
+
+
+namespace
+{
+	//runDma word by word, as the program would do it with instructions
+	void runReference(Machine &machine)
+	{
+		auto &memory = machine.memory;
+		const Word command = memory[DmaCommand];
+		if (!command)
+		{
+			return;
+		}
+		
+		const Word source = memory[DmaSource];
+		const Word destination = memory[DmaDestination];
+		const Word length = memory[DmaLength];
+		const Word value = memory[DmaValue];
+		Word result = length;
+		
+		if (command == DmaMode_Copy)
+		{
+			std::vector<Word> buffer(length);
+			for (Word i = 0; i < length; ++i)
+			{
+				buffer[i] = memory[static_cast<Word>(source + i)];
+			}
+			for (Word i = 0; i < length; ++i)
+			{
+				memory[static_cast<Word>(destination + i)] = buffer[i];
+				machine.markDirty(static_cast<Word>(destination + i));
+			}
+		}
+		else if (command == DmaMode_Fill)
+		{
+			for (Word i = 0; i < length; ++i)
+			{
+				memory[static_cast<Word>(destination + i)] = value;
+				machine.markDirty(static_cast<Word>(destination + i));
+			}
+		}
+		else if (command == DmaMode_Compare)
+		{
+			result = 0;
+			while (result < length &&
+				memory[static_cast<Word>(source + result)] == memory[static_cast<Word>(destination + result)])
+			{
+				++result;
+			}
+		}
+		else
+		{
+			result = 0;
+		}
+		
+		memory[DmaResult] = result;
+		memory[DmaCommand] = 0;
+		memory[InterruptPending] |= InterruptLine_Dma;
+		machine.markDirty(DmaCommand, 2);
+		machine.markDirty(InterruptPending);
+	}
+	
+	struct Generator
+	{
+		std::mt19937 random;
+		
+		Word any()
+		{
+			return static_cast<Word>(random());
+		}
+		
+		Word below(unsigned end)
+		{
+			return static_cast<Word>(random() % end);
+		}
+		
+		//mostly short, sometimes across the whole memory
+		Word getLength()
+		{
+			switch (below(4))
+			{
+			case 0: return below(4);
+			case 1: return below(64);
+			case 2: return below(0x1000);
+			default: return any();
+			}
+		}
+		
+		//near the end of the memory so that ranges wrap around
+		Word getAddress()
+		{
+			return below(2) ? any() : static_cast<Word>(0x10000 - below(0x100));
+		}
+	};
+	
+	bool check(const Machine &machine, const Machine &reference, unsigned transfer)
+	{
+		for (unsigned a = 0; a < MemorySizeInWords; ++a)
+		{
+			if (machine.memory[a] != reference.memory[a])
+			{
+				std::printf("transfer %u: word 0x%04x is 0x%04x instead of 0x%04x\n",
+					transfer, a, machine.memory[a], reference.memory[a]);
+				return false;
+			}
+		}
+		
+		if (machine.dirtyPages != reference.dirtyPages)
+		{
+			std::printf("transfer %u: wrong dirty pages\n", transfer);
+			return false;
+		}
+		return true;
+	}
+}
+
+
+int main()
+{
+	Generator generator;
+	generator.random.seed(1);
+	
+	Machine::Memory memory(MemorySizeInWords);
+	Machine machine(memory);
+	machine.trackDirtyPages = true;
+	
+	unsigned failures = 0;
+	const unsigned transfers = 1000;
+	for (unsigned t = 0; t < transfers && failures < 10; ++t)
+	{
+		//few different values, so that compared ranges have equal words
+		const unsigned values = 1u << generator.below(17);
+		for (auto w = machine.memory.begin(); w != machine.memory.end(); ++w)
+		{
+			*w = generator.below(values);
+		}
+		
+		const Word mode = generator.below(8);
+		const Word source = generator.getAddress();
+		const Word length = generator.getLength();
+		
+		//overlapping in both directions
+		Word destination = generator.getAddress();
+		if (generator.below(2))
+		{
+			destination = static_cast<Word>(source + generator.below(2 * length + 1) - length);
+		}
+		
+		machine.memory[DmaSource] = source;
+		machine.memory[DmaDestination] = destination;
+		machine.memory[DmaLength] = length;
+		machine.memory[DmaValue] = generator.any();
+		machine.memory[DmaCommand] = (mode < 7) ? static_cast<Word>(mode % 3 + 1) : generator.any();
+		
+		//the compared ranges are equal up to a random word
+		if (machine.memory[DmaCommand] == DmaMode_Compare)
+		{
+			for (Word i = 0; i < length; ++i)
+			{
+				machine.memory[static_cast<Word>(destination + i)] = machine.memory[static_cast<Word>(source + i)];
+			}
+			if (length && generator.below(4))
+			{
+				Word &word = machine.memory[static_cast<Word>(destination + generator.below(length))];
+				word = static_cast<Word>(word + 1);
+			}
+		}
+		
+		const Word command = machine.memory[DmaCommand];
+		machine.dirtyPages.reset();
+		Machine reference(machine);
+		
+		runDma(machine);
+		runReference(reference);
+		
+		if (!check(machine, reference, t))
+		{
+			std::printf("  command %u, source 0x%04x, destination 0x%04x, length 0x%04x\n",
+				command, source, destination, length);
+			++failures;
+		}
+	}
+	
+	if (failures)
+	{
+		return 1;
+	}
+	std::printf("%u transfers as expected\n", transfers);
+	return 0;
+}
@@ -0,0 +1,86 @@
+#include "emu/history.hpp"
+#include <cstdio>
+using namespace dcpupp;
+
+
+namespace
+{
+	enum
+	{
+		InputAddress = 0x1000,
+		CopyAddress = 0x2000,
+	};
+	
+	unsigned failures = 0;
+	
+	void expect(const char *what, unsigned actual, unsigned expected)
+	{
+		if (actual != expected)
+		{
+			std::printf("%s is %u instead of %u\n", what, actual, expected);
+			++failures;
+		}
+	}
+	
+	void expectInput(const Machine &machine, Word value)
+	{
+		expect("the input", machine.memory[InputAddress], value);
+		expect("the copy", machine.memory[CopyAddress], value);
+	}
+}
+
+
+int main()
+{
+	//	SET [0x2000], [0x1000]
+	//	SET PC, 0
+	const Word program[] = {0x79e1, CopyAddress, InputAddress, 0x81c1};
+	Machine::Memory memory(MemorySizeInWords);
+	std::copy(program, program + 4, memory.begin());
+	Machine machine(memory);
+	
+	History history(machine, 4);
+	
+	//an input at the position of the first checkpoint
+	history.injectInput(InputAddress, 42);
+	history.step(10);
+	expectInput(machine, 42);
+	history.seek(2);
+	expectInput(machine, 42);
+	history.seek(0);
+	expect("the input at the start", machine.memory[InputAddress], 42);
+	
+	//an input at the position of a later checkpoint, reached by a seek
+	history.seek(10);
+	history.seek(4);
+	history.injectInput(InputAddress, 7);
+	history.step(4);
+	expectInput(machine, 7);
+	history.seek(5);
+	expectInput(machine, 7);
+	history.seek(3);
+	expectInput(machine, 42);
+	history.seek(8);
+	expectInput(machine, 7);
+	
+	//the replay sees the input, too
+	History::Position writer;
+	expect("a write found", history.findLastWrite(CopyAddress, writer), true);
+	expect("the writer", static_cast<unsigned>(writer), 6);
+	expectInput(machine, 7);
+	
+	//inputs survive when old checkpoints are dropped
+	History bounded(machine, 2, 0);
+	bounded.injectInput(InputAddress, 9);
+	bounded.step(1);
+	bounded.step(10);
+	bounded.seek(bounded.getEarliestPosition());
+	expect("the input at the earliest checkpoint", machine.memory[InputAddress], 9);
+	
+	if (failures)
+	{
+		return 1;
+	}
+	std::printf("inputs are replayed\n");
+	return 0;
+}
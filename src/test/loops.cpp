@@ -0,0 +1,321 @@
+#include "emu/machine.hpp"
+#include <cstdio>
+#include <random>
+#include <vector>
+using namespace dcpupp;
+
+
+namespace
+{
+	Word encode(unsigned op, unsigned a, unsigned b)
+	{
+		return static_cast<Word>(op | (a << 4) | (b << 10));
+	}
+	
+	struct Generator
+	{
+		std::mt19937 random;
+		
+		Word any()
+		{
+			return static_cast<Word>(random());
+		}
+		
+		Word below(unsigned end)
+		{
+			return static_cast<Word>(random() % end);
+		}
+		
+		unsigned getRegister()
+		{
+			return below(UniversalRegisterCount);
+		}
+		
+		//a register which is none of the given ones
+		unsigned getOtherRegister(unsigned r0, unsigned r1)
+		{
+			unsigned reg;
+			do
+			{
+				reg = getRegister();
+			}
+			while (reg == r0 || reg == r1);
+			return reg;
+		}
+		
+		//mostly short, sometimes across the whole memory
+		unsigned getIterations()
+		{
+			switch (below(4))
+			{
+			case 0: return 1 + below(16);
+			case 1: return 1 + below(256);
+			case 2: return 1 + below(0x1000);
+			default: return 1 + below(0x10000);
+			}
+		}
+		
+		//near the end of the memory so that ranges wrap around
+		Word getAddress()
+		{
+			return below(2) ? any() : static_cast<Word>(0x10000 - below(0x100));
+		}
+		
+		//a literal argument, small or as the next word
+		unsigned getLiteral(Word value, std::vector<Word> &next)
+		{
+			if (value < 0x20 && below(2))
+			{
+				return Arg_SmallLiteral + value;
+			}
+			next.push_back(value);
+			return Arg_Word;
+		}
+		
+		//[R] or [next word + R] for the address
+		unsigned getIndexed(unsigned reg, Word address, Machine &machine, std::vector<Word> &next)
+		{
+			if (below(2))
+			{
+				machine.registers[reg] = address;
+				return Arg_PtrRegister + reg;
+			}
+			
+			const Word offset = any();
+			machine.registers[reg] = static_cast<Word>(address - offset);
+			next.push_back(offset);
+			return Arg_PtrRegisterWord + reg;
+		}
+	};
+	
+	void append(std::vector<Word> &code, Word instruction, const std::vector<Word> &next)
+	{
+		code.push_back(instruction);
+		code.insert(code.end(), next.begin(), next.end());
+	}
+	
+	//A fill or copy loop in one of the forms which Machine::accelerateLoop
+	//recognizes, followed by a halt. Returns the address of the loop.
+	Word generate(Generator &generator, Machine &machine)
+	{
+		for (unsigned r = 0; r < UniversalRegisterCount; ++r)
+		{
+			machine.registers[r] = generator.any();
+		}
+		
+		const unsigned iterations = generator.getIterations();
+		const int dstDelta = generator.below(2) ? 1 : -1;
+		const unsigned dstReg = generator.getRegister();
+		const Word destination = generator.getAddress();
+		
+		std::vector<Word> moveNext, conditionNext, jumpNext;
+		const unsigned dstArg = generator.getIndexed(dstReg, destination, machine, moveNext);
+		
+		//the source is a literal, a register or [s + S]
+		unsigned srcArg;
+		unsigned srcReg = dstReg;
+		int srcDelta = 0;
+		switch (generator.below(4))
+		{
+		case 0:
+			srcArg = generator.getLiteral(generator.below(2) ? generator.below(0x20) : generator.any(), moveNext);
+			break;
+		
+		case 1:
+			srcArg = generator.getOtherRegister(dstReg, dstReg);
+			break;
+		
+		default:
+			{
+				//the same register or another one, stepped in either direction
+				if (generator.below(4))
+				{
+					srcReg = generator.getOtherRegister(dstReg, dstReg);
+					srcDelta = generator.below(2) ? 1 : -1;
+				}
+				else
+				{
+					srcDelta = dstDelta;
+				}
+				
+				//mostly overlapping with the destination
+				const Word source = generator.below(4) ?
+					static_cast<Word>(destination + generator.below(2 * iterations + 1) - iterations) :
+					generator.getAddress();
+				
+				if (srcReg == dstReg)
+				{
+					srcArg = Arg_PtrRegisterWord + srcReg;
+					moveNext.push_back(static_cast<Word>(source - machine.registers[dstReg]));
+				}
+				else
+				{
+					srcArg = generator.getIndexed(srcReg, source, machine, moveNext);
+				}
+				break;
+			}
+		}
+		
+		//steps of the destination and maybe of another register, in any order
+		unsigned stepRegs[2] = {dstReg, srcReg};
+		int stepDeltas[2] = {dstDelta, srcDelta};
+		unsigned stepCount = (srcReg != dstReg) ? 2 : 1;
+		if (stepCount == 1 &&
+			generator.below(2))
+		{
+			stepRegs[1] = generator.getOtherRegister(dstReg, (srcArg < UniversalRegisterCount) ? srcArg : dstReg);
+			stepDeltas[1] = generator.below(2) ? 1 : -1;
+			stepCount = 2;
+		}
+		if (stepCount == 2 &&
+			generator.below(2))
+		{
+			std::swap(stepRegs[0], stepRegs[1]);
+			std::swap(stepDeltas[0], stepDeltas[1]);
+		}
+		
+		//the counter is one of the stepped registers
+		const unsigned counterIndex = generator.below(stepCount);
+		const unsigned counterReg = stepRegs[counterIndex];
+		const int counterDelta = stepDeltas[counterIndex];
+		const Word counterEnd = static_cast<Word>(machine.registers[counterReg] + counterDelta * static_cast<int>(iterations));
+		
+		unsigned limitArg;
+		const unsigned limitReg = generator.getOtherRegister(stepRegs[0], stepRegs[stepCount - 1]);
+		if (generator.below(2))
+		{
+			limitArg = limitReg;
+			machine.registers[limitReg] = counterEnd;
+		}
+		else
+		{
+			limitArg = generator.getLiteral(counterEnd, conditionNext);
+		}
+		
+		const Word head = generator.getAddress();
+		std::vector<Word> code;
+		append(code, encode(Op_Set, dstArg, srcArg), moveNext);
+		for (unsigned i = 0; i < stepCount; ++i)
+		{
+			code.push_back(encode((stepDeltas[i] > 0) ? Op_Add : Op_Sub, stepRegs[i], Arg_SmallLiteral + 1));
+		}
+		append(code, encode(Op_Ifn, counterReg, limitArg), conditionNext);
+		append(code, encode(Op_Set, Arg_PC, generator.getLiteral(head, jumpNext)), jumpNext);
+		
+		//SUB PC, 1
+		code.push_back(encode(Op_Sub, Arg_PC, Arg_SmallLiteral + 1));
+		
+		for (std::size_t i = 0; i < code.size(); ++i)
+		{
+			machine.memory[static_cast<Word>(head + i)] = code[i];
+		}
+		machine.pc = head;
+		return head;
+	}
+	
+	bool check(const Machine &machine, const Machine &reference, unsigned loop)
+	{
+		for (unsigned r = 0; r < UniversalRegisterCount; ++r)
+		{
+			if (machine.registers[r] != reference.registers[r])
+			{
+				std::printf("loop %u: register %u is 0x%04x instead of 0x%04x\n",
+					loop, r, machine.registers[r], reference.registers[r]);
+				return false;
+			}
+		}
+		
+		if (machine.sp != reference.sp ||
+			machine.pc != reference.pc ||
+			machine.o != reference.o ||
+			machine.skipNext != reference.skipNext)
+		{
+			std::printf("loop %u: PC 0x%04x, SP 0x%04x, O 0x%04x, skip %d instead of 0x%04x, 0x%04x, 0x%04x, %d\n",
+				loop, machine.pc, machine.sp, machine.o, machine.skipNext,
+				reference.pc, reference.sp, reference.o, reference.skipNext);
+			return false;
+		}
+		
+		if (machine.cycles != reference.cycles ||
+			machine.instructions != reference.instructions)
+		{
+			std::printf("loop %u: %llu cycles and %llu instructions instead of %llu and %llu\n",
+				loop,
+				static_cast<unsigned long long>(machine.cycles),
+				static_cast<unsigned long long>(machine.instructions),
+				static_cast<unsigned long long>(reference.cycles),
+				static_cast<unsigned long long>(reference.instructions));
+			return false;
+		}
+		
+		for (unsigned a = 0; a < MemorySizeInWords; ++a)
+		{
+			if (machine.memory[a] != reference.memory[a])
+			{
+				std::printf("loop %u: word 0x%04x is 0x%04x instead of 0x%04x\n",
+					loop, a, machine.memory[a], reference.memory[a]);
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+
+int main()
+{
+	Generator generator;
+	generator.random.seed(1);
+	
+	Machine::Memory memory(MemorySizeInWords);
+	Machine machine(memory);
+	
+	unsigned failures = 0;
+	const unsigned loops = 500;
+	for (unsigned l = 0; l < loops && failures < 10; ++l)
+	{
+		for (auto w = machine.memory.begin(); w != machine.memory.end(); ++w)
+		{
+			*w = generator.any();
+		}
+		machine.cycles = 0;
+		machine.instructions = 0;
+		machine.sp = 0;
+		machine.o = 0;
+		machine.skipNext = false;
+		
+		const Word head = generate(generator, machine);
+		
+		Machine reference(machine);
+		machine.accelerateLoops = true;
+		reference.accelerateLoops = false;
+		
+		//a few slices which may end in the middle of the loop
+		bool equal = true;
+		for (unsigned s = 0; s < 4 && equal; ++s)
+		{
+			const std::uint64_t budget = generator.below(2) ? generator.below(1000) : 0x200000;
+			machine.runSlice(budget);
+			reference.runSlice(budget);
+			equal = check(machine, reference, l);
+		}
+		
+		if (!equal)
+		{
+			std::printf("  loop at 0x%04x: 0x%04x 0x%04x 0x%04x 0x%04x\n",
+				head,
+				reference.memory[head],
+				reference.memory[static_cast<Word>(head + 1)],
+				reference.memory[static_cast<Word>(head + 2)],
+				reference.memory[static_cast<Word>(head + 3)]);
+			++failures;
+		}
+	}
+	
+	if (failures)
+	{
+		return 1;
+	}
+	std::printf("%u loops as expected\n", loops);
+	return 0;
+}